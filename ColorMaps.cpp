@@ -1,76 +1,232 @@
 #include "ColorMaps.h"
 
-#include <QColor>
+#include <cstring>
 
 namespace ColorMaps
 {
 
-ControlPoints BlackBodyRadiation()
+namespace
 {
-    const double rgbPoints[] = {
-        0,   0,              0,              0,
-        0.4, 0.901960784314, 0,              0,
-        0.8, 0.901960784314, 0.901960784314, 0,
-        1,   1,              1,              1 };
 
-    ControlPoints ctrlPts;
-    for (size_t rgb = 0; rgb < sizeof(rgbPoints) / sizeof(double); rgb += 4)
+// 8 bits per channel color, e.g. from a '#RRGGBB' palette
+constexpr ControlPointRgb rgb8(const double x, const int r, const int g, const int b)
+{
+    return ControlPointRgb{ x, r / 255., g / 255., b / 255. };
+}
+
+constexpr ControlPointRgb s_blackBodyRadiation[] = {
+    { 0,   0,              0,              0 },
+    { 0.4, 0.901960784314, 0,              0 },
+    { 0.8, 0.901960784314, 0.901960784314, 0 },
+    { 1,   1,              1,              1 } };
+
+constexpr ControlPointRgb s_coolToWarm[] = {
+    { 0,   0.23137254902000001, 0.298039215686,       0.75294117647100001 },
+    { 0.5, 0.86499999999999999, 0.86499999999999999,  0.86499999999999999 },
+    { 1,   0.70588235294099999, 0.015686274509800001, 0.149019607843 } };
+
+// Qt's darkBlue, blue, cyan, yellow, red and darkRed
+constexpr ControlPointRgb s_jet[] = {
+    rgb8(0.0, 0,   0,   128),
+    rgb8(0.2, 0,   0,   255),
+    rgb8(0.4, 0,   255, 255),
+    rgb8(0.6, 255, 255, 0),
+    rgb8(0.8, 255, 0,   0),
+    rgb8(1.0, 128, 0,   0) };
+
+// matplotlib's perceptually uniform maps, sampled every 1/8
+constexpr ControlPointRgb s_viridis[] = {
+    rgb8(0.0,   0x44, 0x01, 0x54),
+    rgb8(0.125, 0x47, 0x2D, 0x7B),
+    rgb8(0.25,  0x3B, 0x52, 0x8B),
+    rgb8(0.375, 0x2C, 0x72, 0x8E),
+    rgb8(0.5,   0x21, 0x90, 0x8C),
+    rgb8(0.625, 0x27, 0xAD, 0x81),
+    rgb8(0.75,  0x5D, 0xC8, 0x63),
+    rgb8(0.875, 0xAA, 0xDC, 0x32),
+    rgb8(1.0,   0xFD, 0xE7, 0x25) };
+
+constexpr ControlPointRgb s_inferno[] = {
+    rgb8(0.0,   0x00, 0x00, 0x04),
+    rgb8(0.125, 0x1F, 0x0C, 0x48),
+    rgb8(0.25,  0x55, 0x0F, 0x6D),
+    rgb8(0.375, 0x88, 0x22, 0x6A),
+    rgb8(0.5,   0xBA, 0x36, 0x55),
+    rgb8(0.625, 0xE3, 0x59, 0x32),
+    rgb8(0.75,  0xF9, 0x8C, 0x0A),
+    rgb8(0.875, 0xF9, 0xC9, 0x32),
+    rgb8(1.0,   0xFC, 0xFF, 0xA4) };
+
+constexpr ControlPointRgb s_magma[] = {
+    rgb8(0.0,   0x00, 0x00, 0x04),
+    rgb8(0.125, 0x1D, 0x11, 0x47),
+    rgb8(0.25,  0x51, 0x12, 0x7C),
+    rgb8(0.375, 0x82, 0x26, 0x81),
+    rgb8(0.5,   0xB6, 0x36, 0x79),
+    rgb8(0.625, 0xE6, 0x51, 0x64),
+    rgb8(0.75,  0xFB, 0x88, 0x61),
+    rgb8(0.875, 0xFE, 0xC2, 0x87),
+    rgb8(1.0,   0xFC, 0xFD, 0xBF) };
+
+// Google's Turbo (polynomial approximation), sampled every 1/16
+constexpr ControlPointRgb s_turbo[] = {
+    { 0.0,    0.135721, 0.091403, 0.106673 },
+    { 0.0625, 0.287523, 0.244062, 0.685745 },
+    { 0.125,  0.268616, 0.414773, 0.934760 },
+    { 0.1875, 0.197020, 0.585511, 0.969910 },
+    { 0.25,   0.148313, 0.740465, 0.880723 },
+    { 0.3125, 0.162420, 0.866364, 0.733191 },
+    { 0.375,  0.250394, 0.952795, 0.572903 },
+    { 0.4375, 0.401206, 0.992534, 0.428173 },
+    { 0.5,    0.588522, 0.981864, 0.313169 },
+    { 0.5625, 0.777496, 0.920903, 0.231045 },
+    { 0.625,  0.931551, 0.813924, 0.177069 },
+    { 0.6875, 1.000000, 0.669681, 0.141753 },
+    { 0.75,   1.000000, 0.501735, 0.113986 },
+    { 0.8125, 0.934930, 0.328772, 0.084155 },
+    { 0.875,  0.786373, 0.174933, 0.047287 },
+    { 0.9375, 0.631511, 0.070133, 0.006168 },
+    { 1.0,    0.565859, 0.050389, 0.000000 } };
+
+static_assert(isValid(s_blackBodyRadiation), "invalid black body radiation control points");
+static_assert(isValid(s_coolToWarm), "invalid cool to warm control points");
+static_assert(isValid(s_jet), "invalid jet control points");
+static_assert(isValid(s_viridis), "invalid viridis control points");
+static_assert(isValid(s_inferno), "invalid inferno control points");
+static_assert(isValid(s_magma), "invalid magma control points");
+static_assert(isValid(s_turbo), "invalid turbo control points");
+
+constexpr Lut s_blackBodyRadiationLut = makeLut(s_blackBodyRadiation);
+constexpr Lut s_coolToWarmLut = makeLut(s_coolToWarm);
+constexpr Lut s_jetLut = makeLut(s_jet);
+constexpr Lut s_viridisLut = makeLut(s_viridis);
+constexpr Lut s_infernoLut = makeLut(s_inferno);
+constexpr Lut s_magmaLut = makeLut(s_magma);
+constexpr Lut s_turboLut = makeLut(s_turbo);
+
+static_assert(s_jetLut.rgb[0] == 0xff000080u && s_jetLut.rgb[LutSize - 1] == 0xff800000u,
+              "unexpected jet lookup table");
+
+template <size_t N>
+constexpr ColorMap makeColorMap(const char* name, const ControlPointRgb (&points)[N], const Lut& lut)
+{
+    return ColorMap{ name, points, N, &lut };
+}
+
+// same order as the Preset enum
+constexpr ColorMap s_presets[] = {
+    makeColorMap("jet",        s_jet,                s_jetLut),
+    makeColorMap("bbr",        s_blackBodyRadiation, s_blackBodyRadiationLut),
+    makeColorMap("cooltowarm", s_coolToWarm,         s_coolToWarmLut),
+    makeColorMap("viridis",    s_viridis,            s_viridisLut),
+    makeColorMap("inferno",    s_inferno,            s_infernoLut),
+    makeColorMap("magma",      s_magma,              s_magmaLut),
+    makeColorMap("turbo",      s_turbo,              s_turboLut) };
+
+static_assert(sizeof(s_presets) / sizeof(s_presets[0]) == PresetCount, "a preset is missing");
+
+}
+
+const ColorMap& preset(const Preset id)
+{
+    return s_presets[(id >= 0 && id < PresetCount) ? id : JetPreset];
+}
+
+const ColorMap* findPreset(const char* name)
+{
+    if (!name)
     {
-        ctrlPts.push_back(ControlPoint(rgbPoints[rgb],
-                                       rgbPoints[rgb + 1],
-                                       rgbPoints[rgb + 2],
-                                       rgbPoints[rgb + 3]));
+        return nullptr;
     }
-
-    return ctrlPts;
+    for (const ColorMap& colorMap : s_presets)
+    {
+        if (std::strcmp(colorMap.name, name) == 0)
+        {
+            return &colorMap;
+        }
+    }
+    return nullptr;
 }
 
-ControlPoints CoolToWarm()
+namespace
 {
-    const double rgbPoints[] = {
-    0,   0.23137254902000001, 0.298039215686,       0.75294117647100001,
-    0.5, 0.86499999999999999, 0.86499999999999999,  0.86499999999999999,
-    1,   0.70588235294099999, 0.015686274509800001, 0.149019607843 };
 
-    ControlPoints ctrlPts;
-    for (size_t rgb = 0; rgb < sizeof(rgbPoints) / sizeof(double); rgb += 4)
+std::vector<ControlPointRgb> toRgbPoints(const ControlPoints& ctrlPts)
+{
+    std::vector<ControlPointRgb> points;
+    points.reserve(ctrlPts.size());
+    for (const ControlPoint& point : ctrlPts)
     {
-        ctrlPts.push_back(ControlPoint(rgbPoints[rgb],
-                                       rgbPoints[rgb + 1],
-                                       rgbPoints[rgb + 2],
-                                       rgbPoints[rgb + 3]));
+        points.push_back(ControlPointRgb{ std::get<0>(point), std::get<1>(point),
+                                          std::get<2>(point), std::get<3>(point) });
     }
+    return points;
+}
 
-    return ctrlPts;
 }
 
-ControlPoints Jet()
+bool isValid(const ControlPoints& ctrlPts)
 {
-    QColor darkBlue(Qt::darkBlue); // 0.0
-    QColor blue(Qt::blue);         // 0.2
-    QColor cyan(Qt::cyan);         // 0.4
-    QColor yellow(Qt::yellow);     // 0.6
-    QColor red(Qt::red);           // 0.8
-    QColor darkRed(Qt::darkRed);   // 1.0
-
-    const double rgbPoints[] = {
-    0.0, darkBlue.redF(), darkBlue.greenF(), darkBlue.blueF(),
-    0.2, blue.redF(),     blue.greenF(),     blue.blueF(),
-    0.4, cyan.redF(),     cyan.greenF(),     cyan.blueF(),
-    0.6, yellow.redF(),   yellow.greenF(),   yellow.blueF(),
-    0.8, red.redF(),      red.greenF(),      red.blueF(),
-    1.0, darkRed.redF(),  darkRed.greenF(),  darkRed.blueF() };
+    const std::vector<ControlPointRgb> points = toRgbPoints(ctrlPts);
+    return isValid(points.data(), points.size());
+}
 
-    ControlPoints ctrlPts;
-    for (size_t rgb = 0; rgb < sizeof(rgbPoints) / sizeof(double); rgb += 4)
+bool makeLut(const ControlPoints& ctrlPts, Lut& lut)
+{
+    const std::vector<ControlPointRgb> points = toRgbPoints(ctrlPts);
+    if (!isValid(points.data(), points.size()))
     {
-        ctrlPts.push_back(ControlPoint(rgbPoints[rgb],
-                                       rgbPoints[rgb + 1],
-                                       rgbPoints[rgb + 2],
-                                       rgbPoints[rgb + 3]));
+        return false;
     }
+    lut = makeLut(points.data(), points.size());
+    return true;
+}
 
+ControlPoints toControlPoints(const ColorMap& colorMap)
+{
+    ControlPoints ctrlPts;
+    ctrlPts.reserve(colorMap.count);
+    for (size_t i = 0; i < colorMap.count; ++i)
+    {
+        const ControlPointRgb& point = colorMap.points[i];
+        ctrlPts.push_back(ControlPoint(point.x, point.r, point.g, point.b));
+    }
     return ctrlPts;
 }
 
+ControlPoints BlackBodyRadiation()
+{
+    return toControlPoints(preset(BlackBodyRadiationPreset));
+}
+
+ControlPoints CoolToWarm()
+{
+    return toControlPoints(preset(CoolToWarmPreset));
+}
+
+ControlPoints Jet()
+{
+    return toControlPoints(preset(JetPreset));
+}
+
+ControlPoints Viridis()
+{
+    return toControlPoints(preset(ViridisPreset));
+}
+
+ControlPoints Inferno()
+{
+    return toControlPoints(preset(InfernoPreset));
+}
+
+ControlPoints Magma()
+{
+    return toControlPoints(preset(MagmaPreset));
+}
+
+ControlPoints Turbo()
+{
+    return toControlPoints(preset(TurboPreset));
+}
+
 }
@@ -1,6 +1,7 @@
 #ifndef WATERFALLCOLORMAPS_H
 #define WATERFALLCOLORMAPS_H
 
+#include <cstddef>
 #include <tuple>
 #include <vector>
 
@@ -9,7 +10,7 @@ namespace ColorMaps
 
 /* x (control point), red, green, blue
  * all values must be defined between 0.0 and 1.0
- * ControlPoints must be sorted in ascending order of 'x' points.
+ * ControlPoints must be sorted in ascending order of 'x' points (see isValid()).
  */
 typedef std::tuple<double, double, double, double> ControlPoint;
 typedef std::vector<ControlPoint> ControlPoints;
@@ -17,6 +18,127 @@ typedef std::vector<ControlPoint> ControlPoints;
 ControlPoints BlackBodyRadiation();
 ControlPoints CoolToWarm();
 ControlPoints Jet();
+ControlPoints Viridis();
+ControlPoints Inferno();
+ControlPoints Magma();
+ControlPoints Turbo();
+
+/* Compile-time color maps: the control points tables and their lookup tables
+ * are constexpr, validated by static_assert and baked into the binary, so
+ * using a preset neither allocates nor validates anything at runtime
+ * (switching presets is a pointer swap). */
+
+struct ControlPointRgb
+{
+    double x;
+    double r;
+    double g;
+    double b;
+};
+
+// colors interpolated linearly between the control points (like QwtLinearColorMap in RGB mode)
+static const size_t LutSize = 1024;
+
+struct Lut
+{
+    unsigned int rgb[LutSize]; // QRgb: 0xAARRGGBB, opaque
+};
+
+/* the control points go from 0 to 1 in ascending order (equal x: a sharp
+ * step), colors are in [0, 1] */
+constexpr bool isValid(const ControlPointRgb* const points, const size_t count)
+{
+    if (count < 2 || points[0].x != 0. || points[count - 1].x != 1.)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        // negated comparisons: NaN are rejected
+        if ((i > 0 && !(points[i].x >= points[i - 1].x)) ||
+            !(points[i].r >= 0. && points[i].r <= 1.) ||
+            !(points[i].g >= 0. && points[i].g <= 1.) ||
+            !(points[i].b >= 0. && points[i].b <= 1.))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <size_t N>
+constexpr bool isValid(const ControlPointRgb (&points)[N])
+{
+    return isValid(points, N);
+}
+
+constexpr unsigned int toRgb(const double r, const double g, const double b)
+{
+    return 0xff000000u |
+           (unsigned(r * 255. + 0.5) << 16) |
+           (unsigned(g * 255. + 0.5) << 8) |
+            unsigned(b * 255. + 0.5);
+}
+
+// valid control points only (see isValid())
+constexpr Lut makeLut(const ControlPointRgb* const points, const size_t count)
+{
+    Lut lut{};
+    size_t stop = 0;
+    for (size_t i = 0; i < LutSize; ++i)
+    {
+        const double x = double(i) / (LutSize - 1);
+        while (stop + 2 < count && x > points[stop + 1].x)
+        {
+            ++stop;
+        }
+
+        const ControlPointRgb& from = points[stop];
+        const ControlPointRgb& to = points[stop + 1];
+        const double width = to.x - from.x;
+        double t = (width > 0.) ? (x - from.x) / width : 0.;
+        t = (t < 0.) ? 0. : ((t > 1.) ? 1. : t);
+
+        lut.rgb[i] = toRgb(from.r + t * (to.r - from.r),
+                           from.g + t * (to.g - from.g),
+                           from.b + t * (to.b - from.b));
+    }
+    return lut;
+}
+
+template <size_t N>
+constexpr Lut makeLut(const ControlPointRgb (&points)[N])
+{
+    return makeLut(points, N);
+}
+
+// the same for control points defined at runtime (e.g. by the user)
+bool isValid(const ControlPoints& ctrlPts);
+bool makeLut(const ControlPoints& ctrlPts, Lut& lut); // false if they're not valid (lut unchanged)
+
+struct ColorMap
+{
+    const char*            name;   // lower case, e.g. for command line options
+    const ControlPointRgb* points;
+    size_t                 count;
+    const Lut*             lut;
+};
+
+enum Preset
+{
+    JetPreset,
+    BlackBodyRadiationPreset,
+    CoolToWarmPreset,
+    ViridisPreset,
+    InfernoPreset,
+    MagmaPreset,
+    TurboPreset,
+    PresetCount
+};
+
+const ColorMap& preset(const Preset id);
+const ColorMap* findPreset(const char* name); // nullptr if unknown
+ControlPoints toControlPoints(const ColorMap& colorMap);
 
 }
 
@@ -29,7 +29,8 @@ ExportDialog::ExportDialog(QWidget* const parent) :
     });
 
     QStringList plotsList;
-    plotsList << "Horizontal Plot" << "Vertical Plot" << "Waterfall Plot";
+    plotsList << "Horizontal Plot" << "Vertical Plot" << "Waterfall Plot"
+              << "Waterfall Data (.npy)" << "Waterfall Data (.csv)";
     m_Internals->Ui.PlotsList->addItems(plotsList);
 
     for (int i = 0; i < m_Internals->Ui.PlotsList->count(); ++i)
@@ -59,3 +60,13 @@ bool ExportDialog::getExportWaterfallCurve() const
 {
     return m_Internals->Ui.PlotsList->item(2)->checkState() == Qt::Checked;
 }
+
+bool ExportDialog::getExportWaterfallDataNpy() const
+{
+    return m_Internals->Ui.PlotsList->item(3)->checkState() == Qt::Checked;
+}
+
+bool ExportDialog::getExportWaterfallDataCsv() const
+{
+    return m_Internals->Ui.PlotsList->item(4)->checkState() == Qt::Checked;
+}
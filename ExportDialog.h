@@ -15,6 +15,8 @@ public:
     bool getExportWaterfallCurve() const;
     bool getExportHorizontalCurve() const;
     bool getExportVerticalCurve() const;
+    bool getExportWaterfallDataNpy() const;
+    bool getExportWaterfallDataCsv() const;
 
 private:
     Q_DISABLE_COPY(ExportDialog)
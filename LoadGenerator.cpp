@@ -0,0 +1,211 @@
+#include "LoadGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// xorshift32: cheap enough to not be the bottleneck of the generator
+inline float nextNoise(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return float(state >> 8) * (1.f / 16777216.f);
+}
+
+// gaussian peak of width sigma (in points) added to a layer
+template <class T>
+void addPeak(T* const layer, const size_t length, const double position, const double sigma, const double amplitude)
+{
+    const long begin = std::max(0L, long(position - 4 * sigma));
+    const long end = std::min(long(length), long(position + 4 * sigma) + 1);
+    const double invTwoSigma2 = 1. / (2 * sigma * sigma);
+    for (long i = begin; i < end; ++i)
+    {
+        const double d = i - position;
+        layer[i] += T(amplitude * std::exp(-d * d * invTwoSigma2));
+    }
+}
+
+template <class T>
+void fillLayer(T* const values, const size_t length, const LoadGenerator::Shape shape,
+               const double seconds, uint32_t& noiseState)
+{
+    if (shape == LoadGenerator::Noise)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            values[i] = T(256.f * nextNoise(noiseState));
+        }
+        return;
+    }
+
+    // noise floor
+    for (size_t i = 0; i < length; ++i)
+    {
+        values[i] = T(10.f + 20.f * nextNoise(noiseState));
+    }
+
+    if (shape == LoadGenerator::Tones)
+    {
+        addPeak(values, length, length * 0.2, 2., 200.);
+        addPeak(values, length, length * 0.5, 4., 150.);
+        addPeak(values, length, length * 0.75, 1., 220. * (0.5 + 0.5 * std::sin(seconds)));
+    }
+    else
+    {
+        addPeak(values, length, length * std::fmod(seconds / 5., 1.), std::max(length / 200., 1.), 220.);
+    }
+}
+
+}
+
+LoadGenerator::LoadGenerator(QObject* const parent /*= nullptr*/) :
+    QObject(parent),
+    m_stop(false),
+    m_generated(0),
+    m_overruns(0)
+{
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    stop();
+}
+
+void LoadGenerator::start(const Settings& settings)
+{
+    stop();
+
+    m_settings = settings;
+    m_settings.layersPerSecond = std::max(m_settings.layersPerSecond, 0.1);
+    m_settings.layerPoints = std::max(m_settings.layerPoints, size_t(1));
+    m_settings.burst = std::max(m_settings.burst, size_t(1));
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.insert(m_free.end(), std::make_move_iterator(m_ready.begin()), std::make_move_iterator(m_ready.end()));
+        m_ready.clear();
+        m_notified = false;
+    }
+    m_generated = 0;
+    m_overruns = 0;
+    m_stop = false;
+    m_worker = std::thread(&LoadGenerator::run, this);
+}
+
+void LoadGenerator::stop()
+{
+    m_stop = true;
+    if (m_worker.joinable())
+    {
+        m_worker.join();
+    }
+}
+
+void LoadGenerator::take(std::vector<Layer>& layers)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    layers.insert(layers.end(), std::make_move_iterator(m_ready.begin()), std::make_move_iterator(m_ready.end()));
+    m_ready.clear();
+    m_notified = false;
+}
+
+void LoadGenerator::recycle(std::vector<Layer>& layers)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_free.insert(m_free.end(), std::make_move_iterator(layers.begin()), std::make_move_iterator(layers.end()));
+    layers.clear();
+}
+
+void LoadGenerator::run()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const Settings settings = m_settings;
+    const Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(settings.burst / settings.layersPerSecond));
+    const size_t maxPending = std::max(size_t(settings.layersPerSecond), 4 * settings.burst);
+    const Clock::time_point begin = Clock::now();
+
+    std::vector<Layer> burst;
+    Clock::time_point next = begin;
+    while (!m_stop)
+    {
+        // 1. buffers from the free list (allocations only happen until the pipeline is primed)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            while (burst.size() < settings.burst && !m_free.empty())
+            {
+                burst.push_back(std::move(m_free.back()));
+                m_free.pop_back();
+            }
+        }
+        burst.resize(settings.burst);
+
+        // 2. generate
+        const Clock::time_point now = Clock::now();
+        const double seconds = std::chrono::duration<double>(now - begin).count();
+        for (Layer& layer : burst)
+        {
+            generate(layer, seconds);
+            layer.timestamp = std::time(nullptr);
+            layer.generated = now;
+        }
+        m_generated += burst.size();
+
+        // 3. hand them to the GUI thread, or drop them if it's late
+        bool notify = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_ready.size() + burst.size() > maxPending)
+            {
+                ++m_overruns;
+                m_free.insert(m_free.end(), std::make_move_iterator(burst.begin()), std::make_move_iterator(burst.end()));
+            }
+            else
+            {
+                m_ready.insert(m_ready.end(), std::make_move_iterator(burst.begin()), std::make_move_iterator(burst.end()));
+                notify = !m_notified;
+                m_notified = true;
+            }
+        }
+        burst.clear();
+        if (notify)
+        {
+            emit layersReady(); // queued to the GUI thread
+        }
+
+        // 4. wait for the next burst, without trying to catch up after a stall
+        next += period;
+        const Clock::time_point after = Clock::now();
+        if (next < after)
+        {
+            next = after;
+        }
+        while (!m_stop && Clock::now() < next)
+        {
+            std::this_thread::sleep_until(std::min(next, Clock::now() + std::chrono::milliseconds(50)));
+        }
+    }
+}
+
+void LoadGenerator::generate(Layer& layer, const double seconds)
+{
+    const size_t length = m_settings.layerPoints;
+    layer.values.resize(length);
+
+    if (m_settings.type == Float32)
+    {
+        // generated in single precision then widened, like a float32 device would be
+        m_floatLayer.resize(length);
+        fillLayer(m_floatLayer.data(), length, m_settings.shape, seconds, m_noiseState);
+        std::copy(m_floatLayer.cbegin(), m_floatLayer.cend(), layer.values.begin());
+    }
+    else
+    {
+        fillLayer(layer.values.data(), length, m_settings.shape, seconds, m_noiseState);
+    }
+}
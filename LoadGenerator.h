@@ -0,0 +1,96 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QObject>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Synthetic layers generator running on a worker thread (demo/stress test).
+ * Layers are generated in bursts at a given rate into recycled buffers and
+ * handed to the GUI thread through take(), layersReady() being emitted once
+ * until they're taken. When the GUI doesn't keep up (about one second of
+ * layers pending), bursts are dropped and counted as overruns: that's where
+ * the machine saturates.
+ */
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Shape
+    {
+        Tones, // a few fixed peaks over a noise floor
+        Chirp, // a peak sweeping the layer (5 seconds period)
+        Noise  // uniform noise in [0, 256[
+    };
+
+    enum SampleType
+    {
+        Float32, // generated in single precision
+        Float64
+    };
+
+    struct Settings
+    {
+        double     layersPerSecond = 100.;
+        size_t     layerPoints = 1024;
+        size_t     burst = 1;
+        Shape      shape = Tones;
+        SampleType type = Float64;
+    };
+
+    struct Layer
+    {
+        std::vector<double> values;
+        time_t timestamp = 0;
+        std::chrono::steady_clock::time_point generated;
+    };
+
+    explicit LoadGenerator(QObject* const parent = nullptr);
+    ~LoadGenerator() override;
+
+    void start(const Settings& settings);
+    void stop();
+    bool isRunning() const { return m_worker.joinable(); }
+    const Settings& settings() const { return m_settings; }
+
+    // GUI thread: appends the pending layers to layers, give them back with recycle()
+    void take(std::vector<Layer>& layers);
+    void recycle(std::vector<Layer>& layers);
+
+    uint64_t generatedLayers() const { return m_generated; }
+    uint64_t overruns() const { return m_overruns; }
+
+signals:
+    void layersReady();
+
+protected:
+    void run();
+    void generate(Layer& layer, double seconds);
+
+    Settings           m_settings;
+    std::thread        m_worker;
+    std::atomic<bool>  m_stop;
+    std::atomic<uint64_t> m_generated;
+    std::atomic<uint64_t> m_overruns;
+
+    std::mutex         m_mutex; // protects the queues below
+    std::vector<Layer> m_ready;
+    std::vector<Layer> m_free;
+    bool               m_notified = false;
+
+    // worker only
+    std::vector<float> m_floatLayer;
+    uint32_t           m_noiseState = 0x12345678u;
+
+private:
+    Q_DISABLE_COPY(LoadGenerator)
+};
+
+#endif // LOADGENERATOR_H
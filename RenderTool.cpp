@@ -0,0 +1,483 @@
+/* qwtwaterfall-render: renders recorded waterfall data into PNG tiles or a single strip
+ * image without any GUI (QtCore + QtGui only).
+ *
+ * Input: a NumPy .npy file (2D, float32 or float64, C order) or a raw binary matrix
+ * (--layer-points and --type are then required), one layer per row, oldest first.
+ * Optional timestamps (one int64 time_t per layer) are stored in the PNG text chunks.
+ *
+ * Tiles are rendered by a pool of worker threads, each one reading only the layers of
+ * its tile, so the memory used is bounded by threads x tile size (except for --strip
+ * where the whole image is kept in memory).
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QImage>
+#include <QString>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ColorMaps.h"
+#include "WaterfallKernels.h"
+#include "WaterfallParallel.h"
+#include "WaterfallRenderer.h"
+
+namespace
+{
+
+struct Source
+{
+    QString path;
+    qint64  dataOffset = 0;
+    size_t  rows = 0;
+    size_t  cols = 0;
+    bool    isFloat32 = false;
+};
+
+bool openNpy(const QString& path, Source& source, QString& error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        error = file.errorString();
+        return false;
+    }
+
+    // magic string, version, header length and a Python dict literal
+    const QByteArray preamble = file.read(10);
+    if (preamble.size() < 10 || !preamble.startsWith("\x93NUMPY"))
+    {
+        error = "not a .npy file";
+        return false;
+    }
+
+    const int major = uchar(preamble[6]);
+    quint32 headerLength = uchar(preamble[8]) | (uchar(preamble[9]) << 8);
+    qint64 headerStart = 10;
+    if (major >= 2)
+    {
+        const QByteArray extra = file.read(2);
+        headerLength |= (uchar(extra[0]) << 16) | (uchar(extra[1]) << 24);
+        headerStart = 12;
+    }
+    const QString header = QString::fromLatin1(file.read(headerLength));
+
+    if (header.contains("'fortran_order': True"))
+    {
+        error = "Fortran ordered arrays are not supported";
+        return false;
+    }
+    if (header.contains("'<f4'"))
+    {
+        source.isFloat32 = true;
+    }
+    else if (header.contains("'<f8'"))
+    {
+        source.isFloat32 = false;
+    }
+    else
+    {
+        error = "only little endian float32/float64 arrays are supported";
+        return false;
+    }
+
+    const int shapeBegin = header.indexOf("'shape': (");
+    const int shapeEnd = header.indexOf(')', shapeBegin);
+    if (shapeBegin < 0 || shapeEnd < 0)
+    {
+        error = "missing shape";
+        return false;
+    }
+    const QStringList shape = header.mid(shapeBegin + 10, shapeEnd - shapeBegin - 10)
+                                    .split(',', QString::SkipEmptyParts);
+    if (shape.size() != 2)
+    {
+        error = "the array must have 2 dimensions (layers, layer points)";
+        return false;
+    }
+
+    source.path = path;
+    source.rows = shape[0].trimmed().toULongLong();
+    source.cols = shape[1].trimmed().toULongLong();
+    source.dataOffset = headerStart + headerLength;
+    return true;
+}
+
+bool openRaw(const QString& path, const size_t cols, const bool isFloat32, Source& source, QString& error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        error = file.errorString();
+        return false;
+    }
+    if (cols == 0)
+    {
+        error = "--layer-points is required for raw files";
+        return false;
+    }
+
+    source.path = path;
+    source.cols = cols;
+    source.isFloat32 = isFloat32;
+    source.dataOffset = 0;
+    source.rows = size_t(file.size()) / (cols * (isFloat32 ? sizeof(float) : sizeof(double)));
+    return true;
+}
+
+// reads count layers from first (converted to double)
+bool readRows(QFile& file, const Source& source, const size_t first, const size_t count,
+              std::vector<char>& raw, std::vector<double>& out)
+{
+    const size_t sampleSize = source.isFloat32 ? sizeof(float) : sizeof(double);
+    const size_t samples = count * source.cols;
+
+    raw.resize(samples * sampleSize);
+    out.resize(samples);
+    if (!file.seek(source.dataOffset + qint64(first * source.cols * sampleSize)) ||
+        file.read(raw.data(), qint64(raw.size())) != qint64(raw.size()))
+    {
+        return false;
+    }
+
+    if (source.isFloat32)
+    {
+        std::vector<float> values(samples);
+        std::memcpy(values.data(), raw.data(), raw.size());
+        WaterfallKernels::copy(out.data(), values.data(), samples);
+    }
+    else
+    {
+        std::memcpy(out.data(), raw.data(), raw.size());
+    }
+    return true;
+}
+
+struct Options
+{
+    size_t width = 0;          // 0: layer points
+    size_t tileHeight = 1024;
+    size_t layersPerPixel = 1;
+    bool   reduceMax = true;
+    bool   strip = false;
+    bool   autoRange = true;
+    double rangeMin = 0.;
+    double rangeMax = 1.;
+    size_t threads = 0;
+    QString output;
+};
+
+/* renders the output rows [outFirst, outFirst + outCount) (oldest first) in buffer,
+ * the newest row on top */
+bool renderTile(const Source& source, const Options& options, const WaterfallRenderer& renderer,
+                const size_t outFirst, const size_t outCount,
+                QRgb* const buffer, const size_t stride)
+{
+    QFile file(source.path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    const size_t first = outFirst * options.layersPerPixel;
+    const size_t count = std::min(outCount * options.layersPerPixel, source.rows - first);
+
+    std::vector<char> raw;
+    std::vector<double> layers;
+    if (!readRows(file, source, first, count, raw, layers))
+    {
+        return false;
+    }
+
+    // 1. reduce layersPerPixel layers into a single one
+    std::vector<double> reduced(outCount * source.cols);
+    for (size_t row = 0; row < outCount; ++row)
+    {
+        const size_t begin = row * options.layersPerPixel;
+        const size_t end = std::min(begin + options.layersPerPixel, count);
+        double* const out = reduced.data() + row * source.cols;
+
+        WaterfallKernels::copy(out, layers.data() + begin * source.cols, source.cols);
+        for (size_t layer = begin + 1; layer < end; ++layer)
+        {
+            const double* const in = layers.data() + layer * source.cols;
+            if (options.reduceMax)
+            {
+                WaterfallKernels::max(out, in, source.cols);
+            }
+            else
+            {
+                WaterfallKernels::add(out, in, source.cols);
+            }
+        }
+        if (!options.reduceMax && end - begin > 1)
+        {
+            const double factor = 1. / (end - begin);
+            for (size_t i = 0; i < source.cols; ++i)
+            {
+                out[i] *= factor;
+            }
+        }
+    }
+
+    // 2. resample the layers to the image width
+    const size_t width = options.width;
+    std::vector<double> resampled;
+    const double* matrix = reduced.data();
+    if (width != source.cols)
+    {
+        resampled.resize(outCount * width);
+        for (size_t row = 0; row < outCount; ++row)
+        {
+            const double* const in = reduced.data() + row * source.cols;
+            double* const out = resampled.data() + row * width;
+            if (source.cols > width)
+            {
+                if (options.reduceMax)
+                {
+                    WaterfallKernels::decimateMax(out, width, in, source.cols);
+                }
+                else
+                {
+                    WaterfallKernels::decimateMean(out, width, in, source.cols);
+                }
+            }
+            else
+            {
+                WaterfallKernels::interpolateLinear(out, width, in, source.cols);
+            }
+        }
+        matrix = resampled.data();
+    }
+
+    renderer.renderMatrix(matrix, outCount, width, buffer, int(width), int(outCount), stride);
+    return true;
+}
+
+void computeRange(const Source& source, const size_t threads, double& rangeMin, double& rangeMax)
+{
+    std::mutex mutex;
+    rangeMin = std::numeric_limits<double>::max();
+    rangeMax = std::numeric_limits<double>::lowest();
+
+    WaterfallParallel::parallelFor(source.rows, 256, [&](const size_t begin, const size_t end)
+    {
+        QFile file(source.path);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            return;
+        }
+
+        double localMin = std::numeric_limits<double>::max();
+        double localMax = std::numeric_limits<double>::lowest();
+        std::vector<char> raw;
+        std::vector<double> layers;
+        const size_t chunk = 256;
+        for (size_t first = begin; first < end; first += chunk)
+        {
+            const size_t count = std::min(chunk, end - first);
+            if (!readRows(file, source, first, count, raw, layers))
+            {
+                break;
+            }
+            const auto minMax = std::minmax_element(layers.cbegin(), layers.cend());
+            localMin = std::min(localMin, *minMax.first);
+            localMax = std::max(localMax, *minMax.second);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        rangeMin = std::min(rangeMin, localMin);
+        rangeMax = std::max(rangeMax, localMax);
+    }, threads);
+}
+
+void setTimestamps(QImage& image, const std::vector<qint64>& timestamps, const size_t first, const size_t last)
+{
+    if (first < timestamps.size() && last < timestamps.size())
+    {
+        image.setText("FirstTimestamp", QString::number(timestamps[first]));
+        image.setText("LastTimestamp", QString::number(timestamps[last]));
+    }
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("qwtwaterfall-render");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders recorded waterfall data into PNG images.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "Input file: .npy (float32/float64) or raw binary matrix.");
+    parser.addOptions({
+        { "output", "Output file prefix (tiles) or file name (strip).", "path", "waterfall" },
+        { "layer-points", "Points per layer (raw input).", "count" },
+        { "type", "Sample type of a raw input: float32 or float64.", "type", "float64" },
+        { "timestamps", "Raw file of int64 timestamps, one per layer.", "file" },
+        { "width", "Image width in pixels (default: layer points).", "pixels" },
+        { "tile-height", "Height of a tile in pixels.", "pixels", "1024" },
+        { "layers-per-pixel", "Layers reduced into a pixel row.", "count", "1" },
+        { "reduce", "Reduction of layers and bins: max or mean.", "mode", "max" },
+        { "range", "Color range 'min,max' (default: data range).", "min,max" },
+        { "colormap", "Color map: jet, bbr, cooltowarm, viridis, inferno, magma or turbo.", "name", "jet" },
+        { "threads", "Worker threads (default: all cores).", "count", "0" },
+        { "strip", "Render a single strip image instead of tiles." }
+    });
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1)
+    {
+        parser.showHelp(1);
+    }
+
+    const QString input = parser.positionalArguments().front();
+    Source source;
+    QString error;
+    const bool opened = input.endsWith(".npy", Qt::CaseInsensitive)
+            ? openNpy(input, source, error)
+            : openRaw(input, parser.value("layer-points").toULongLong(),
+                      parser.value("type") == "float32", source, error);
+    if (!opened || source.rows == 0 || source.cols == 0)
+    {
+        std::cerr << "Can't read " << input.toStdString() << ": "
+                  << (error.isEmpty() ? "empty data" : error.toStdString()) << std::endl;
+        return 1;
+    }
+
+    Options options;
+    options.output = parser.value("output");
+    options.width = parser.isSet("width") ? parser.value("width").toULongLong() : source.cols;
+    options.tileHeight = std::max(parser.value("tile-height").toULongLong(), 1ULL);
+    options.layersPerPixel = std::max(parser.value("layers-per-pixel").toULongLong(), 1ULL);
+    options.reduceMax = (parser.value("reduce") != "mean");
+    options.strip = parser.isSet("strip");
+    options.threads = parser.value("threads").toULongLong();
+    if (options.width == 0)
+    {
+        options.width = source.cols;
+    }
+
+    const ColorMaps::ColorMap* colorMap = ColorMaps::findPreset(parser.value("colormap").toLatin1().constData());
+    WaterfallRenderer renderer;
+    renderer.setColorMap((colorMap) ? *colorMap : ColorMaps::preset(ColorMaps::JetPreset));
+    renderer.setThreadCount(1); // the tiles are already rendered in parallel
+
+    if (parser.isSet("range"))
+    {
+        const QStringList range = parser.value("range").split(',');
+        options.autoRange = (range.size() != 2);
+        if (!options.autoRange)
+        {
+            options.rangeMin = range[0].toDouble();
+            options.rangeMax = range[1].toDouble();
+        }
+    }
+    if (options.autoRange)
+    {
+        computeRange(source, options.threads, options.rangeMin, options.rangeMax);
+    }
+    renderer.setRange(options.rangeMin, options.rangeMax);
+
+    std::vector<qint64> timestamps;
+    if (parser.isSet("timestamps"))
+    {
+        QFile file(parser.value("timestamps"));
+        if (file.open(QIODevice::ReadOnly))
+        {
+            timestamps.resize(size_t(file.size()) / sizeof(qint64));
+            file.read(reinterpret_cast<char*>(timestamps.data()), qint64(timestamps.size() * sizeof(qint64)));
+        }
+    }
+
+    const size_t outRows = (source.rows + options.layersPerPixel - 1) / options.layersPerPixel;
+    const size_t tiles = (outRows + options.tileHeight - 1) / options.tileHeight;
+
+    QImage strip;
+    if (options.strip)
+    {
+        strip = QImage(int(options.width), int(outRows), QImage::Format_ARGB32);
+        if (strip.isNull())
+        {
+            std::cerr << "The strip image is too large, render tiles instead." << std::endl;
+            return 1;
+        }
+    }
+
+    QRgb* const stripBits = options.strip ? reinterpret_cast<QRgb*>(strip.bits()) : nullptr;
+    const size_t stripStride = options.strip ? strip.bytesPerLine() / sizeof(QRgb) : 0;
+
+    // each worker takes the next tile until there are none left
+    std::atomic<size_t> nextTile(0);
+    std::atomic<bool> failed(false);
+    const size_t workers = std::min((options.threads > 0) ? options.threads : WaterfallParallel::threadCount(),
+                                    tiles);
+    WaterfallParallel::parallelFor(workers, 1, [&](const size_t, const size_t)
+    {
+        for (size_t tile = nextTile++; tile < tiles && !failed; tile = nextTile++)
+        {
+            const size_t outFirst = tile * options.tileHeight;
+            const size_t outCount = std::min(options.tileHeight, outRows - outFirst);
+            const size_t lastLayer = std::min((outFirst + outCount) * options.layersPerPixel, source.rows) - 1;
+
+            if (options.strip)
+            {
+                // the oldest tile is at the bottom of the strip
+                const size_t y = outRows - outFirst - outCount;
+                if (!renderTile(source, options, renderer, outFirst, outCount,
+                                stripBits + y * stripStride, stripStride))
+                {
+                    failed = true;
+                }
+                continue;
+            }
+
+            QImage image(int(options.width), int(outCount), QImage::Format_ARGB32);
+            if (!renderTile(source, options, renderer, outFirst, outCount,
+                            reinterpret_cast<QRgb*>(image.bits()), image.bytesPerLine() / sizeof(QRgb)))
+            {
+                failed = true;
+                continue;
+            }
+            setTimestamps(image, timestamps, outFirst * options.layersPerPixel, lastLayer);
+
+            const QString fileName = QString("%1_%2.png").arg(options.output).arg(tile, 5, 10, QChar('0'));
+            if (!image.save(fileName, "PNG"))
+            {
+                std::cerr << "Can't write " << fileName.toStdString() << std::endl;
+                failed = true;
+            }
+        }
+    }, workers);
+
+    if (!failed && options.strip)
+    {
+        setTimestamps(strip, timestamps, 0, source.rows - 1);
+        const QString fileName = options.output.endsWith(".png", Qt::CaseInsensitive)
+                ? options.output : options.output + ".png";
+        if (!strip.save(fileName, "PNG"))
+        {
+            std::cerr << "Can't write " << fileName.toStdString() << std::endl;
+            failed = true;
+        }
+    }
+
+    if (failed)
+    {
+        std::cerr << "Rendering failed." << std::endl;
+        return 1;
+    }
+
+    std::cout << source.rows << " layers rendered in "
+              << (options.strip ? size_t(1) : tiles) << " image(s)." << std::endl;
+    return 0;
+}
@@ -0,0 +1,173 @@
+#ifndef WATERFALLACCUMULATOR_H
+#define WATERFALLACCUMULATOR_H
+
+#include <chrono>
+#include <ctime>
+#include <type_traits>
+#include <vector>
+
+#include "WaterfallKernels.h"
+
+/* Time-decimation stage placed in front of WaterfallData::addData.
+ * Incoming frames are integrated in place (mean, max-hold, min-hold or
+ * exponential averaging) and a layer is only emitted when the integration
+ * window (N frames and/or T milliseconds) is complete.
+ */
+template <class T>
+class WaterfallAccumulator
+{
+    static_assert(std::is_arithmetic<T>::value, "WaterfallAccumulator's data must be numeric !");
+
+public:
+    enum Mode
+    {
+        None,        // pass-through, every frame is a layer
+        Mean,
+        MaxHold,
+        MinHold,
+        Exponential
+    };
+
+    // integers are accumulated in double to avoid overflows when summing
+    typedef typename std::conditional<std::is_floating_point<T>::value, T, double>::type AccumulatorType;
+
+    WaterfallAccumulator() = default;
+
+    /* frames: number of frames per layer (0 = unused)
+     * msecs:  duration of the window in milliseconds (0 = unused)
+     * If both are set, the first condition met completes the window.
+     * alpha:  smoothing factor of the Exponential mode (0 < alpha <= 1) */
+    void setup(const Mode mode, const size_t frames, const int msecs = 0, const double alpha = 0.1)
+    {
+        m_mode = mode;
+        m_frames = frames;
+        m_msecs = msecs;
+        m_alpha = AccumulatorType(alpha);
+        if (m_mode != None && m_frames == 0 && m_msecs <= 0)
+        {
+            m_frames = 1;
+        }
+        reset();
+    }
+
+    Mode getMode() const { return m_mode; }
+    size_t getFrames() const { return m_frames; }
+    int getMsecs() const { return m_msecs; }
+
+    bool isActive() const { return m_mode != None; }
+
+    // drop the current (incomplete) window
+    void reset()
+    {
+        m_count = 0;
+        m_emitted = false;
+    }
+
+    /* returns true when the window is complete, the integrated layer is then
+     * available through layer() and its timestamp through timestamp() */
+    bool push(const T* const data, const size_t length, const time_t timestamp)
+    {
+        if (m_layer.size() != length)
+        {
+            m_acc.assign(length, AccumulatorType(0));
+            m_layer.assign(length, T(0));
+            reset();
+        }
+
+        if (m_count == 0)
+        {
+            m_windowStart = std::chrono::steady_clock::now();
+
+            // the exponential average is never restarted, the window only
+            // defines the emission rate
+            if (m_mode != Exponential || !m_emitted)
+            {
+                WaterfallKernels::copy(m_acc.data(), data, length);
+            }
+            else
+            {
+                WaterfallKernels::exponential(m_acc.data(), data, length, m_alpha);
+            }
+        }
+        else
+        {
+            switch (m_mode)
+            {
+            case Mean:
+                WaterfallKernels::add(m_acc.data(), data, length);
+                break;
+            case MaxHold:
+                WaterfallKernels::max(m_acc.data(), data, length);
+                break;
+            case MinHold:
+                WaterfallKernels::min(m_acc.data(), data, length);
+                break;
+            case Exponential:
+                WaterfallKernels::exponential(m_acc.data(), data, length, m_alpha);
+                break;
+            case None:
+            default:
+                WaterfallKernels::copy(m_acc.data(), data, length);
+                break;
+            }
+        }
+
+        ++m_count;
+        m_timestamp = timestamp;
+
+        if (!windowComplete())
+        {
+            return false;
+        }
+
+        const AccumulatorType factor = (m_mode == Mean) ? AccumulatorType(1) / AccumulatorType(m_count)
+                                                        : AccumulatorType(1);
+        WaterfallKernels::scale(m_layer.data(), m_acc.data(), length, factor);
+
+        m_count = 0;
+        m_emitted = true;
+        return true;
+    }
+
+    const T* layer() const { return m_layer.data(); }
+    size_t layerLength() const { return m_layer.size(); }
+    time_t timestamp() const { return m_timestamp; }
+
+    // number of frames integrated in the current (incomplete) window
+    size_t pendingFrames() const { return m_count; }
+
+protected:
+    bool windowComplete() const
+    {
+        if (m_mode == None)
+        {
+            return true;
+        }
+        if (m_frames > 0 && m_count >= m_frames)
+        {
+            return true;
+        }
+        if (m_msecs > 0)
+        {
+            const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - m_windowStart);
+            return elapsed.count() >= m_msecs;
+        }
+        return false;
+    }
+
+    Mode   m_mode = None;
+    size_t m_frames = 1;
+    int    m_msecs = 0;
+    AccumulatorType m_alpha = AccumulatorType(0.1);
+
+    size_t m_count = 0;     // frames in the current window
+    bool   m_emitted = false;
+    time_t m_timestamp = 0; // timestamp of the last frame of the window
+    std::chrono::steady_clock::time_point m_windowStart;
+
+    std::vector<AccumulatorType> m_acc;
+    std::vector<T>               m_layer;
+};
+
+#endif // WATERFALLACCUMULATOR_H
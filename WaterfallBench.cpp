@@ -0,0 +1,451 @@
+/* waterfall_bench: measures the hot paths of the waterfall over a parameter grid
+ * (layer points, history extent, sample type, canvas size, channels count) and
+ * prints JSON results that can be diffed between releases.
+ *
+ * Runs headless: the offscreen QPA platform is used unless QT_QPA_PLATFORM is set.
+ * Configurations whose storage exceeds --max-mb are reported as skipped.
+ */
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QRegion>
+
+#include <qwt_color_map.h>
+#include <qwt_plot_spectrogram.h>
+#include <qwt_scale_map.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "WaterfallChannels.h"
+#include "WaterfallData.h"
+#include "WaterfallGrid.h"
+#include "WaterfallIndexImage.h"
+#include "WaterfallParallel.h"
+#include "Waterfallplot.h"
+
+namespace
+{
+
+struct Config
+{
+    size_t layerPoints;
+    size_t historyExtent;
+};
+
+struct Measure
+{
+    qint64 iterations = 0;
+    double nsPerOp = 0.;
+};
+
+// doubles the iterations count until the batch lasts at least minTime
+template <class Fn>
+Measure measure(Fn fn, const std::chrono::milliseconds minTime)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    fn(); // warm up
+
+    Measure result;
+    for (qint64 iterations = 1; ; iterations *= 2)
+    {
+        const Clock::time_point start = Clock::now();
+        for (qint64 i = 0; i < iterations; ++i)
+        {
+            fn();
+        }
+        const Clock::duration elapsed = Clock::now() - start;
+        if (elapsed >= minTime || iterations >= (qint64(1) << 30))
+        {
+            result.iterations = iterations;
+            result.nsPerOp = double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / iterations;
+            return result;
+        }
+    }
+}
+
+// layers cycled during the ingest (random values in [0, 256[ like the demo)
+template <class T>
+std::vector<T> makeLayers(const size_t layerPoints, const size_t count)
+{
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> distribution(0., 256.);
+    std::vector<T> layers(layerPoints * count);
+    for (T& value : layers)
+    {
+        value = T(distribution(generator));
+    }
+    return layers;
+}
+
+// exposes the protected curves update, the history is filled without refreshing the curves
+class BenchWaterfallplot : public Waterfallplot
+{
+public:
+    BenchWaterfallplot() : Waterfallplot(nullptr) {}
+
+    void fill(const std::vector<double>& layers, const size_t count)
+    {
+        const size_t layerPoints = m_data->getLayerPoints();
+        for (size_t i = 0; i < m_data->getMaxHistoryLength(); ++i)
+        {
+            m_data->addData(layers.data() + (i % count) * layerPoints, layerPoints, time_t(i));
+        }
+    }
+
+    using Waterfallplot::updateCurvesData;
+};
+
+class Bench
+{
+public:
+    Bench(const std::chrono::milliseconds minTime, const size_t maxBytes) :
+        m_minTime(minTime),
+        m_maxBytes(maxBytes)
+    {
+    }
+
+    template <class T>
+    void run(const Config& config, const std::vector<QSize>& canvases, const char* typeName);
+
+    void runCurves(const Config& config);
+
+    void runChannels(const Config& config, const std::vector<QSize>& canvases, const size_t channels);
+
+    // thread counts and tile size of the tiled rasterizer scaling measures
+    void setScaling(const std::vector<size_t>& threads, const int tileSize)
+    {
+        m_scalingThreads = threads;
+        m_tileSize = tileSize;
+    }
+
+    QJsonArray results() const { return m_results; }
+
+protected:
+    void add(const char* name, const char* typeName, const Config& config,
+             const Measure& result, const QSize& canvas = QSize(), const double opsScale = 1.,
+             const size_t threads = 0, const size_t channels = 0)
+    {
+        QJsonObject object;
+        object["name"] = name;
+        object["type"] = typeName;
+        object["layerPoints"] = qint64(config.layerPoints);
+        object["historyExtent"] = qint64(config.historyExtent);
+        if (canvas.isValid())
+        {
+            object["canvas"] = QString("%1x%2").arg(canvas.width()).arg(canvas.height());
+        }
+        if (threads > 0)
+        {
+            object["threads"] = qint64(threads);
+            object["tileSize"] = m_tileSize;
+        }
+        if (channels > 0)
+        {
+            object["channels"] = qint64(channels);
+        }
+        object["iterations"] = result.iterations;
+        object["nsPerOp"] = result.nsPerOp / opsScale;
+        m_results.append(object);
+
+        std::cerr << name << " " << typeName << " " << config.layerPoints << "x" << config.historyExtent
+                  << " " << result.nsPerOp / opsScale << " ns";
+        if (threads > 0)
+        {
+            std::cerr << " (" << threads << " threads)";
+        }
+        if (channels > 0)
+        {
+            std::cerr << " (" << channels << " channels)";
+        }
+        std::cerr << std::endl;
+    }
+
+    void skip(const char* typeName, const Config& config, const size_t channels = 0)
+    {
+        QJsonObject object;
+        object["name"] = "skipped";
+        object["type"] = typeName;
+        object["layerPoints"] = qint64(config.layerPoints);
+        object["historyExtent"] = qint64(config.historyExtent);
+        if (channels > 0)
+        {
+            object["channels"] = qint64(channels);
+        }
+        m_results.append(object);
+    }
+
+    const std::chrono::milliseconds m_minTime;
+    const size_t m_maxBytes;
+    std::vector<size_t> m_scalingThreads;
+    int m_tileSize = 64;
+    QJsonArray m_results;
+};
+
+template <class T>
+void Bench::run(const Config& config, const std::vector<QSize>& canvases, const char* typeName)
+{
+    if (config.layerPoints * config.historyExtent * sizeof(T) > m_maxBytes)
+    {
+        skip(typeName, config);
+        return;
+    }
+
+    const size_t layersCount = 64;
+    const std::vector<T> layers = makeLayers<T>(config.layerPoints, layersCount);
+
+    // the spectrogram owns the data
+    WaterfallData<T>* const data = new WaterfallData<T>(0, 500, config.historyExtent, config.layerPoints);
+    QwtPlotSpectrogram spectrogram;
+    spectrogram.setData(data);
+    spectrogram.setRenderThreadCount(0); // like Waterfallplot
+    spectrogram.setColorMap(new QwtLinearColorMap(Qt::darkBlue, Qt::darkRed));
+    data->setRange(0, 256);
+
+    // history filled before measuring, addData then always evicts a layer
+    for (size_t i = 0; i < config.historyExtent; ++i)
+    {
+        data->addData(layers.data() + (i % layersCount) * config.layerPoints, config.layerPoints, time_t(i));
+    }
+
+    size_t next = 0;
+    add("addData", typeName, config, measure([&]()
+    {
+        data->addData(layers.data() + (next % layersCount) * config.layerPoints, config.layerPoints, time_t(next));
+        ++next;
+    }, m_minTime));
+
+    double rangeMin, rangeMax;
+    add("getDataRange", typeName, config, measure([&]()
+    {
+        data->getDataRange(rangeMin, rangeMax);
+    }, m_minTime));
+
+    // random points inside the data intervals, 4096 samples per op
+    const size_t samples = 4096;
+    std::vector<QPointF> points(samples);
+    std::mt19937 generator(7);
+    const QwtInterval xInterval = data->interval(Qt::XAxis);
+    const QwtInterval yInterval = data->interval(Qt::YAxis);
+    std::uniform_real_distribution<double> xDistribution(xInterval.minValue(), xInterval.maxValue());
+    std::uniform_real_distribution<double> yDistribution(yInterval.minValue(), yInterval.maxValue());
+    for (QPointF& point : points)
+    {
+        point = QPointF(xDistribution(generator), yDistribution(generator));
+    }
+    volatile double sink = 0.;
+    add("value", typeName, config, measure([&]()
+    {
+        double sum = 0.;
+        for (const QPointF& point : points)
+        {
+            sum += data->value(point.x(), point.y());
+        }
+        sink = sum;
+    }, m_minTime), QSize(), double(samples));
+    Q_UNUSED(sink)
+
+    // full rasterization of the whole data through QwtPlotSpectrogram
+    for (const QSize& canvas : canvases)
+    {
+        QImage image(canvas, QImage::Format_ARGB32);
+        const QRectF rect(0, 0, canvas.width(), canvas.height());
+        QwtScaleMap xMap, yMap;
+        xMap.setPaintInterval(rect.left(), rect.right());
+        xMap.setScaleInterval(data->interval(Qt::XAxis).minValue(), data->interval(Qt::XAxis).maxValue());
+        yMap.setPaintInterval(rect.bottom(), rect.top());
+        yMap.setScaleInterval(data->interval(Qt::YAxis).minValue(), data->interval(Qt::YAxis).maxValue());
+
+        add("render", typeName, config, measure([&]()
+        {
+            QPainter painter(&image);
+            spectrogram.draw(&painter, xMap, yMap, rect);
+        }, m_minTime), canvas);
+
+        // tiled rasterization (as Waterfallplot's spectrogram) on 1 to N threads of the pool
+        const QRectF area(xInterval.minValue(), yInterval.minValue(), xInterval.width(), yInterval.width());
+        WaterfallIndexImage indices;
+        indices.setTileSize(m_tileSize);
+        for (const size_t threads : m_scalingThreads)
+        {
+            add("rasterizeTiles", typeName, config, measure([&]()
+            {
+                data->initRaster(area, canvas);
+                indices.rasterize(canvas.width(), canvas.height(), [&](const int x, const int y)
+                {
+                    return data->value(xMap.invTransform(x), yMap.invTransform(y));
+                }, threads);
+                data->discardRaster();
+            }, m_minTime), canvas, 1., threads);
+        }
+    }
+}
+
+void Bench::runCurves(const Config& config)
+{
+    if (config.layerPoints * config.historyExtent * sizeof(double) > m_maxBytes)
+    {
+        return;
+    }
+
+    const size_t layersCount = 64;
+    const std::vector<double> layers = makeLayers<double>(config.layerPoints, layersCount);
+
+    BenchWaterfallplot plot;
+    plot.setDataDimensions(0, 500, config.historyExtent, config.layerPoints);
+    plot.fill(layers, layersCount);
+    plot.setMarker(250, plot.getOffset() + config.historyExtent / 2);
+
+    add("updateCurvesData", "double", config, measure([&]()
+    {
+        plot.updateCurvesData();
+    }, m_minTime));
+}
+
+// frame ingest of every channel, then a grid paint of all the channels and of the top left corner only
+void Bench::runChannels(const Config& config, const std::vector<QSize>& canvases, const size_t channels)
+{
+    if (channels * config.layerPoints * config.historyExtent * sizeof(double) > m_maxBytes)
+    {
+        skip("double", config, channels);
+        return;
+    }
+
+    const size_t framesCount = 16;
+    const size_t frameSize = channels * config.layerPoints;
+    const std::vector<double> frames = makeLayers<double>(frameSize, framesCount);
+
+    WaterfallChannels<double> data(channels, 0, 500, config.historyExtent, config.layerPoints);
+    for (size_t i = 0; i < config.historyExtent; ++i)
+    {
+        data.addFrame(frames.data() + (i % framesCount) * frameSize, config.layerPoints, time_t(i));
+    }
+
+    size_t next = 0;
+    add("addFrame", "double", config, measure([&]()
+    {
+        data.addFrame(frames.data() + (next % framesCount) * frameSize, config.layerPoints, time_t(next));
+        ++next;
+    }, m_minTime), QSize(), 1., 0, channels);
+
+    WaterfallGrid grid;
+    grid.setChannels(&data);
+    grid.setRange(0, 256);
+    grid.setAttribute(Qt::WA_DontShowOnScreen); // shown for the resize events only
+    grid.show();
+    for (const QSize& canvas : canvases)
+    {
+        grid.resize(canvas);
+        QImage image(canvas, QImage::Format_ARGB32);
+        add("gridPaint", "double", config, measure([&]()
+        {
+            grid.render(&image);
+        }, m_minTime), canvas, 1., 0, channels);
+
+        // e.g. a grid scrolled in a QScrollArea: only the exposed cells are rendered
+        const QRegion corner(0, 0, canvas.width() / 4, canvas.height() / 4);
+        add("gridPaintExposed", "double", config, measure([&]()
+        {
+            grid.render(&image, QPoint(), corner);
+        }, m_minTime), canvas, 1., 0, channels);
+    }
+}
+
+std::vector<size_t> parseSizes(const QString& list)
+{
+    std::vector<size_t> sizes;
+    for (const QString& value : list.split(',', QString::SkipEmptyParts))
+    {
+        sizes.push_back(value.toULongLong());
+    }
+    return sizes;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+    QApplication::setApplicationName("waterfall_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Waterfall hot paths benchmark (JSON output).");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "layer-points", "Comma separated layer points.", "list", "128,1024,8192,65536" },
+        { "history", "Comma separated history extents.", "list", "64,1024,16384,100000" },
+        { "canvas", "Comma separated canvas sizes (WxH).", "list", "640x480,1920x1080" },
+        { "threads", "Comma separated thread counts of the tiled rasterizer.", "list", "1,2,4,8,16,32" },
+        { "channels", "Comma separated channels counts of the multi-channel measures.", "list", "16,64" },
+        { "tile-size", "Tiles side of the tiled rasterizer (pixels).", "pixels", "64" },
+        { "min-time", "Minimum duration of a measure (ms).", "ms", "200" },
+        { "max-mb", "Configurations using more storage are skipped (MiB).", "MiB", "1024" },
+        { "output", "JSON output file (default: stdout).", "file" }
+    });
+    parser.process(app);
+
+    std::vector<QSize> canvases;
+    for (const QString& canvas : parser.value("canvas").split(',', QString::SkipEmptyParts))
+    {
+        const QStringList size = canvas.split('x');
+        if (size.size() == 2)
+        {
+            canvases.push_back(QSize(size[0].toInt(), size[1].toInt()));
+        }
+    }
+
+    Bench bench(std::chrono::milliseconds(parser.value("min-time").toInt()),
+                size_t(parser.value("max-mb").toULongLong()) * 1024 * 1024);
+    bench.setScaling(parseSizes(parser.value("threads")), std::max(parser.value("tile-size").toInt(), 1));
+
+    for (const size_t layerPoints : parseSizes(parser.value("layer-points")))
+    {
+        for (const size_t historyExtent : parseSizes(parser.value("history")))
+        {
+            const Config config = { layerPoints, historyExtent };
+            bench.run<float>(config, canvases, "float");
+            bench.run<double>(config, canvases, "double");
+            bench.runCurves(config);
+            for (const size_t channels : parseSizes(parser.value("channels")))
+            {
+                bench.runChannels(config, canvases, channels);
+            }
+        }
+    }
+
+    QJsonObject root;
+    root["benchmark"] = "waterfall_bench";
+    root["qt"] = qVersion();
+    root["threads"] = qint64(WaterfallParallel::threadCount());
+    root["results"] = bench.results();
+    const QByteArray json = QJsonDocument(root).toJson();
+
+    if (parser.isSet("output"))
+    {
+        QFile file(parser.value("output"));
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size())
+        {
+            std::cerr << "Can't write " << parser.value("output").toStdString() << std::endl;
+            return 1;
+        }
+    }
+    else
+    {
+        std::cout << json.constData();
+    }
+    return 0;
+}
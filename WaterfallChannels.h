@@ -0,0 +1,139 @@
+#ifndef WATERFALLCHANNELS_H
+#define WATERFALLCHANNELS_H
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <memory>
+#include <vector>
+
+#include "WaterfallData.h"
+#include "WaterfallParallel.h"
+
+/* Waterfalls of several channels (e.g. 16 to 64 receivers) in a single
+ * contiguous allocation of channels x history x layer points values.
+ * Every channel is a WaterfallData over its slice of the storage, so it can
+ * be rendered, viewed or exported like any other waterfall, and a frame of
+ * all the channels is ingested at once with addFrame() (in parallel when the
+ * frame is large enough).
+ * The dimensions are fixed: resize the channels by creating a new object.
+ */
+template <class T>
+class WaterfallChannels
+{
+public:
+    WaterfallChannels(const size_t channels,
+                      double dXMin, double dXMax, // X bounds
+                      const size_t historyExtent,
+                      const size_t layerPoints) :
+        m_layerPoints(layerPoints),
+        m_historyExtent(historyExtent),
+        m_storage(channels * historyExtent * layerPoints),
+        m_timestamps(channels * historyExtent)
+    {
+        m_channels.reserve(channels);
+        for (size_t i = 0; i < channels; ++i)
+        {
+            m_channels.emplace_back(new WaterfallData<T>(dXMin, dXMax, historyExtent, layerPoints,
+                                                         m_storage.data() + i * historyExtent * layerPoints,
+                                                         m_timestamps.data() + i * historyExtent));
+        }
+    }
+
+    size_t channelCount() const { return m_channels.size(); }
+    size_t getLayerPoints() const { return m_layerPoints; }
+    size_t getMaxHistoryLength() const { return m_historyExtent; }
+
+    WaterfallData<T>& channel(const size_t i) { return *m_channels[i]; }
+    const WaterfallData<T>& channel(const size_t i) const { return *m_channels[i]; }
+
+    /* block: a layer of layerPoints values per channel, channel after channel
+     * (layers of another length are resampled if the channels' rebin mode allows it).
+     * Returns false if a channel rejected its layer. */
+    bool addFrame(const T* const block, const size_t layerPoints, const time_t timestamp)
+    {
+        std::atomic<bool> added(true);
+        // small frames aren't worth waking up threads
+        const size_t minChunk = std::max(size_t(1), size_t(32768) / std::max(layerPoints, size_t(1)));
+        WaterfallParallel::parallelFor(m_channels.size(), minChunk, [&](const size_t begin, const size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                if (!m_channels[i]->addData(block + i * layerPoints, layerPoints, timestamp))
+                {
+                    added = false;
+                }
+            }
+        });
+        return added;
+    }
+
+    void setRebinMode(const typename WaterfallData<T>::RebinMode mode)
+    {
+        for (auto& data : m_channels)
+        {
+            data->setRebinMode(mode);
+        }
+    }
+
+    void setRange(const double dLower, const double dUpper)
+    {
+        for (auto& data : m_channels)
+        {
+            data->setRange(dLower, dUpper);
+        }
+    }
+
+    void clear()
+    {
+        for (auto& data : m_channels)
+        {
+            data->clear();
+        }
+    }
+
+    // stored data range over all the channels
+    void getDataRange(double& rangeMin, double& rangeMax) const
+    {
+        rangeMin = 0;
+        rangeMax = 1;
+        bool first = true;
+        for (const auto& data : m_channels)
+        {
+            if (data->getHistoryLength() == 0)
+            {
+                continue;
+            }
+            double channelMin;
+            double channelMax;
+            data->getDataRange(channelMin, channelMax);
+            rangeMin = (first) ? channelMin : std::min(rangeMin, channelMin);
+            rangeMax = (first) ? channelMax : std::max(rangeMax, channelMax);
+            first = false;
+        }
+    }
+
+    size_t getMemoryUsage() const
+    {
+        size_t usage = m_storage.capacity() * sizeof(T) + m_timestamps.capacity() * sizeof(time_t);
+        for (const auto& data : m_channels)
+        {
+            usage += sizeof(WaterfallData<T>) + data->getMemoryUsage();
+        }
+        return usage;
+    }
+
+protected:
+    const size_t m_layerPoints;
+    const size_t m_historyExtent;
+
+    std::vector<T>      m_storage;    // channels x history x layer points
+    std::vector<time_t> m_timestamps; // channels x history
+    std::vector<std::unique_ptr<WaterfallData<T>>> m_channels;
+
+private:
+    WaterfallChannels(const WaterfallChannels&) = delete;
+    WaterfallChannels& operator=(const WaterfallChannels&) = delete;
+};
+
+#endif // WATERFALLCHANNELS_H
@@ -0,0 +1,163 @@
+/* waterfall_channels_test: checks WaterfallChannels and WaterfallGrid (run by ctest).
+ *  - addFrame: frames of channel specific values (a small frame ingested on the
+ *    calling thread, a large one in parallel) must land in each channel's slice
+ *    of the storage, with the frame's timestamp, once the history wrapped,
+ *  - grid: every channel of a grid must be painted in its canvas, and a partial
+ *    paint must only render the exposed cells.
+ *
+ * Runs headless: the offscreen QPA platform is used unless QT_QPA_PLATFORM is set.
+ * Exits with 1 if a check fails.
+ */
+
+#include <QApplication>
+#include <QImage>
+#include <QRegion>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "WaterfallChannels.h"
+#include "WaterfallGrid.h"
+
+namespace
+{
+
+// value of the bin i of the channel c in the frame f
+double frameValue(const size_t c, const size_t f, const size_t i)
+{
+    return double(c * 1000 + (f + i) % 100);
+}
+
+std::vector<double> makeFrame(const size_t channels, const size_t layerPoints, const size_t f)
+{
+    std::vector<double> frame(channels * layerPoints);
+    for (size_t c = 0; c < channels; ++c)
+    {
+        for (size_t i = 0; i < layerPoints; ++i)
+        {
+            frame[c * layerPoints + i] = frameValue(c, f, i);
+        }
+    }
+    return frame;
+}
+
+bool report(const char* const check, const bool passed, const QString& details)
+{
+    std::cout << check << ": " << ((passed) ? "passed" : "FAILED") << " (" << details.toStdString() << ")"
+              << std::endl;
+    return passed;
+}
+
+bool checkAddFrame(const char* const check, const size_t channels, const size_t layerPoints)
+{
+    const size_t history = 8;
+    const size_t frames = history + 3; // the history wrapped
+
+    WaterfallChannels<double> data(channels, 0, 500, history, layerPoints);
+    bool added = true;
+    for (size_t f = 0; f < frames; ++f)
+    {
+        added = data.addFrame(makeFrame(channels, layerPoints, f).data(), layerPoints, time_t(1000 + f)) && added;
+    }
+
+    // the channels are consecutive slices of a single allocation
+    size_t mismatches = 0;
+    for (size_t c = 0; c < channels; ++c)
+    {
+        const WaterfallData<double>& channel = data.channel(c);
+        mismatches += (channel.getData() != data.channel(0).getData() + c * history * layerPoints);
+        mismatches += (channel.getHistoryLength() != history);
+        for (size_t row = 0; row < history; ++row)
+        {
+            const size_t f = frames - history + row;
+            mismatches += (channel.getLayerDate(double(row)) != time_t(1000 + f));
+            const double* const layer = channel.getLayer(row);
+            for (size_t i = 0; i < layerPoints; ++i)
+            {
+                mismatches += (layer[i] != frameValue(c, f, i));
+            }
+        }
+    }
+
+    return report(check, added && mismatches == 0,
+                  QString("%1 channels of %2 bins, %3 mismatches").arg(channels).arg(layerPoints).arg(mismatches));
+}
+
+// exposes the layout and the rendered images of the cells
+class TestGrid : public WaterfallGrid
+{
+public:
+    const std::vector<QRect>& canvases() const { return m_layout.canvases; }
+    const std::vector<QImage>& images() const { return m_images; }
+};
+
+bool checkGrid()
+{
+    const size_t channels = 9;
+    const size_t layerPoints = 64;
+    const size_t history = 32;
+
+    // each channel is flat at its own value: its own color
+    WaterfallChannels<double> data(channels, 0, 500, history, layerPoints);
+    std::vector<double> frame(channels * layerPoints);
+    for (size_t c = 0; c < channels; ++c)
+    {
+        std::fill(frame.begin() + c * layerPoints, frame.begin() + (c + 1) * layerPoints, double(c));
+    }
+    for (size_t f = 0; f < history; ++f)
+    {
+        data.addFrame(frame.data(), layerPoints, time_t(1000 + f));
+    }
+
+    TestGrid grid;
+    grid.setChannels(&data);
+    grid.setRange(0, double(channels - 1));
+    grid.setAttribute(Qt::WA_DontShowOnScreen); // shown for the resize events only
+    grid.show();
+    grid.resize(640, 480);
+    if (grid.canvases().size() != channels)
+    {
+        return report("grid", false, QString("%1 canvases").arg(grid.canvases().size()));
+    }
+
+    // partial paint of the first cell only (its canvas and title)
+    const QRect first = grid.canvases()[0];
+    QImage image(grid.size(), QImage::Format_ARGB32);
+    grid.render(&image, QPoint(), QRegion(first));
+    size_t rendered = 0;
+    for (const QImage& cell : grid.images())
+    {
+        rendered += !cell.isNull();
+    }
+    const bool partial = (rendered == 1);
+
+    // full paint: the center of each canvas has the color of its channel
+    WaterfallRenderer renderer; // same color map and range as the grid
+    renderer.setRange(0, double(channels - 1));
+    grid.render(&image);
+    size_t mismatches = 0;
+    for (size_t c = 0; c < channels; ++c)
+    {
+        mismatches += (image.pixel(grid.canvases()[c].center()) != renderer.color(double(c)));
+    }
+
+    return report("grid", partial && mismatches == 0,
+                  QString("%1 cells rendered by the partial paint, %2 mismatches").arg(rendered).arg(mismatches));
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+
+    bool passed = checkAddFrame("addFrame", 4, 16);
+    passed = checkAddFrame("addFrame parallel", 64, 4096) && passed;
+    passed = checkGrid() && passed;
+    return (passed) ? 0 : 1;
+}
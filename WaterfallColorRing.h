@@ -0,0 +1,198 @@
+#ifndef WATERFALLCOLORRING_H
+#define WATERFALLCOLORRING_H
+
+#include <QImage>
+#include <QRectF>
+#include <QRgb>
+#include <QSize>
+
+#include <cmath>
+#include <vector>
+
+#include "ColorMaps.h"
+#include "WaterfallData.h"
+#include "WaterfallParallel.h"
+#include "WaterfallRenderer.h"
+
+/* Optional ring of pre-colorized rows (QRgb) mirroring the layers of a
+ * WaterfallData: rows are colorized once, through the color lookup table,
+ * when their layer is added, so rendering a frame (scrolling, panning,
+ * zooming) is a plain gather of these pixels. The raw data is kept: a range
+ * or color map change recolors the whole ring (in parallel) losslessly.
+ * The ring has the physical layout of the data's ring buffer, a row is
+ * found with the data's head. Memory: 4 bytes per value.
+ */
+class WaterfallColorRing
+{
+public:
+    explicit WaterfallColorRing(const ColorMaps::ControlPoints& ctrlPts = ColorMaps::Jet()) :
+        m_colors(ctrlPts)
+    {
+    }
+
+    void setEnabled(const bool enabled, const WaterfallData<double>* const data)
+    {
+        m_enabled = enabled;
+        if (!m_enabled)
+        {
+            std::vector<QRgb>().swap(m_pixels);
+            m_rows = 0;
+            m_layerPoints = 0;
+        }
+        else if (data)
+        {
+            reset(*data);
+        }
+    }
+    bool isEnabled() const { return m_enabled; }
+
+    bool setColorMap(const ColorMaps::ControlPoints& ctrlPts, const WaterfallData<double>* const data)
+    {
+        if (!m_colors.setColorMap(ctrlPts))
+        {
+            return false;
+        }
+        if (m_enabled && data)
+        {
+            recolor(*data);
+        }
+        return true;
+    }
+
+    void setColorMap(const ColorMaps::ColorMap& colorMap, const WaterfallData<double>* const data)
+    {
+        m_colors.setColorMap(colorMap);
+        if (m_enabled && data)
+        {
+            recolor(*data);
+        }
+    }
+
+    void setRange(const double dLower, const double dUpper, const WaterfallData<double>* const data)
+    {
+        m_colors.setRange(dLower, dUpper);
+        if (m_enabled && data)
+        {
+            recolor(*data);
+        }
+    }
+
+    // dimensions or history changed
+    void reset(const WaterfallData<double>& data)
+    {
+        if (!m_enabled)
+        {
+            return;
+        }
+        m_rows = data.getMaxHistoryLength();
+        m_layerPoints = data.getLayerPoints();
+        m_pixels.resize(m_rows * m_layerPoints);
+        recolor(data);
+    }
+
+    // after data.addData(): colorizes the newest layer only
+    void addLayer(const WaterfallData<double>& data)
+    {
+        if (!m_enabled)
+        {
+            return;
+        }
+        if (m_rows != data.getMaxHistoryLength() || m_layerPoints != data.getLayerPoints())
+        {
+            reset(data);
+            return;
+        }
+        colorizeRow(data, (data.getHead() + m_rows - 1) % m_rows);
+    }
+
+    // recolors every row, in parallel
+    void recolor(const WaterfallData<double>& data)
+    {
+        if (m_pixels.size() != data.getMaxHistoryLength() * data.getLayerPoints())
+        {
+            reset(data);
+            return;
+        }
+        WaterfallParallel::parallelFor(m_rows, 16, [&](const size_t begin, const size_t end)
+        {
+            for (size_t row = begin; row < end; ++row)
+            {
+                colorizeRow(data, row);
+            }
+        });
+    }
+
+    /* Image of the window area (X values, layers coordinates like the spectrogram's
+     * raster) sampled at the pixels' centers, the top row shows the newest layers. */
+    QImage render(const WaterfallData<double>& data, const QRectF& area, const QSize& size) const
+    {
+        QImage image(size, QImage::Format_ARGB32);
+        const int width = size.width();
+        const int height = size.height();
+        if (width <= 0 || height <= 0 || m_pixels.empty())
+        {
+            image.fill(0u);
+            return image;
+        }
+
+        const double xMin = data.getXMin();
+        const double xMax = data.getXMax();
+        const double dx = area.width() / width;
+        std::vector<long> columns(width);
+        for (int x = 0; x < width; ++x)
+        {
+            const double value = area.left() + (x + 0.5) * dx;
+            columns[x] = (value >= xMin && value < xMax) ? long(data.getColumn(value)) : -1;
+        }
+
+        const double offset = data.getOffset();
+        const size_t head = data.getHead();
+        const double dy = area.height() / height;
+        const double yTop = area.top() + area.height();
+        QRgb* const bits = reinterpret_cast<QRgb*>(image.bits());
+        const size_t stride = image.bytesPerLine() / sizeof(QRgb);
+
+        WaterfallParallel::parallelFor(size_t(height), 64, [&](const size_t begin, const size_t end)
+        {
+            for (size_t y = begin; y < end; ++y)
+            {
+                QRgb* const out = bits + y * stride;
+                const double row = std::floor(yTop - (y + 0.5) * dy - offset);
+                if (row < 0. || row >= double(m_rows))
+                {
+                    std::fill(out, out + width, QRgb(0u));
+                    continue;
+                }
+                const QRgb* const in = m_pixels.data() + ((head + size_t(row)) % m_rows) * m_layerPoints;
+                for (int x = 0; x < width; ++x)
+                {
+                    const long col = columns[x];
+                    out[x] = (col < 0) ? QRgb(0u) : in[col];
+                }
+            }
+        });
+        return image;
+    }
+
+    size_t getMemoryUsage() const { return m_pixels.capacity() * sizeof(QRgb); }
+
+protected:
+    // physical row of the data's ring buffer
+    void colorizeRow(const WaterfallData<double>& data, const size_t row)
+    {
+        const double* const in = data.getData() + row * m_layerPoints;
+        QRgb* const out = m_pixels.data() + row * m_layerPoints;
+        for (size_t col = 0; col < m_layerPoints; ++col)
+        {
+            out[col] = m_colors.color(in[col]);
+        }
+    }
+
+    WaterfallRenderer m_colors; // only its lookup table is used
+    bool              m_enabled = false;
+    std::vector<QRgb> m_pixels; // rows x layer points, physical order
+    size_t            m_rows = 0;
+    size_t            m_layerPoints = 0;
+};
+
+#endif // WATERFALLCOLORRING_H
@@ -0,0 +1,157 @@
+#include "WaterfallCurveExtractor.h"
+
+#include <algorithm>
+#include <limits>
+
+WaterfallCurveExtractor::WaterfallCurveExtractor(QObject* const parent /*= nullptr*/) :
+    QObject(parent),
+    m_generation(0)
+{
+}
+
+WaterfallCurveExtractor::~WaterfallCurveExtractor()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeUp.notify_one();
+    if (m_worker.joinable())
+    {
+        m_worker.join();
+    }
+}
+
+void WaterfallCurveExtractor::request(const WaterfallData<double>* const data, const size_t row, const size_t col)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_data = data;
+        m_row = row;
+        m_col = col;
+        m_requestGeneration = ++m_generation;
+        m_pending = true;
+    }
+    m_wakeUp.notify_one();
+
+    // started with the first request, the worker then sleeps between the drags
+    if (!m_worker.joinable())
+    {
+        m_worker = std::thread(&WaterfallCurveExtractor::run, this);
+    }
+}
+
+void WaterfallCurveExtractor::cancel()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_generation;
+    m_pending = false;
+    m_hasReady = false;
+}
+
+void WaterfallCurveExtractor::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this]() { return !m_busy; });
+}
+
+bool WaterfallCurveExtractor::take(Result& result)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_hasReady)
+    {
+        return false;
+    }
+    m_hasReady = false;
+    if (m_ready.generation != m_generation)
+    {
+        return false;
+    }
+    std::swap(result, m_ready);
+    return true;
+}
+
+void WaterfallCurveExtractor::run()
+{
+    Result work; // its buffers are swapped with m_ready and reused
+    for (;;)
+    {
+        const WaterfallData<double>* data = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeUp.wait(lock, [this]() { return m_stop || m_pending; });
+            if (m_stop)
+            {
+                return;
+            }
+            data = m_data;
+            work.row = m_row;
+            work.col = m_col;
+            work.generation = m_requestGeneration;
+            m_pending = false;
+            m_busy = true;
+        }
+
+        extract(*data, work);
+
+        bool notify = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // the pointer moved again (or the data changed) meanwhile: drop it
+            if (work.generation == m_generation)
+            {
+                notify = !m_hasReady;
+                std::swap(work, m_ready);
+                m_hasReady = true;
+            }
+            m_busy = false;
+        }
+        m_idle.notify_all();
+        if (notify)
+        {
+            emit extracted(); // queued to the GUI thread
+        }
+    }
+}
+
+void WaterfallCurveExtractor::extract(const WaterfallData<double>& data, Result& result)
+{
+    const size_t all = std::numeric_limits<size_t>::max();
+    result.layer.clear();
+    result.column.clear();
+
+    // the copy is done with the data pinned (addData() waits), taken again if a layer
+    // was added (or the data resized) between the view and the copy
+    bool done = false;
+    while (!done)
+    {
+        const WaterfallData<double>::View view = data.view(0, all, 0, all);
+        result.maxHistory = view.rows();
+        result.layerPoints = view.cols();
+        result.offset = view.offset();
+        if (!view.isValid() || result.row >= view.rows() || result.col >= view.cols())
+        {
+            return;
+        }
+
+        view.read(0, view.rows(), [&](const size_t first)
+        {
+            if (first > 0)
+            {
+                return;
+            }
+
+            const double* const layer = view.row(result.row);
+            result.layer.assign(layer, layer + view.cols());
+
+            const size_t currentHistory = view.filledRows();
+            result.firstRow = view.rows() - currentHistory;
+            result.column.resize(currentHistory);
+            for (size_t r = 0; r < currentHistory; ++r)
+            {
+                result.column[r] = view.at(result.firstRow + r, result.col);
+            }
+            done = true;
+        });
+    }
+}
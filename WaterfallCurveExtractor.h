@@ -0,0 +1,81 @@
+#ifndef WATERFALLCURVEEXTRACTOR_H
+#define WATERFALLCURVEEXTRACTOR_H
+
+#include <QObject>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "WaterfallData.h"
+
+/* Extracts the marker's layer (row) and column from the history on a worker
+ * thread, so dragging the picker over a long history doesn't gather a full
+ * column on the GUI thread at every mouse move.
+ * Only the latest request matters: a new request replaces the pending one and
+ * bumps the generation, an extraction that completes with an older generation
+ * is dropped (cancel() does the same). extracted() is emitted (queued to the
+ * GUI thread) once until the result is taken.
+ */
+class WaterfallCurveExtractor : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Result
+    {
+        uint64_t generation = 0;
+        size_t   row = 0;                 // history row of the layer
+        size_t   col = 0;
+        size_t   maxHistory = 0;          // dimensions and offset of the data at extraction
+        size_t   layerPoints = 0;
+        double   offset = 0.;
+        std::vector<double> layer;        // layerPoints values
+        std::vector<double> column;       // filled history (oldest first)
+        size_t   firstRow = 0;            // history row of column[0]
+    };
+
+    explicit WaterfallCurveExtractor(QObject* const parent = nullptr);
+    ~WaterfallCurveExtractor() override;
+
+    // data must outlive the extractor (or a cancel() followed by the end of the running extraction)
+    void request(const WaterfallData<double>* const data, const size_t row, const size_t col);
+    void cancel();
+    void wait(); // until the running extraction (if any) is done, e.g. before the data is released
+
+    // GUI thread: swaps the latest extraction into result, false if there's none or if it's stale
+    bool take(Result& result);
+
+signals:
+    void extracted();
+
+protected:
+    void run();
+    static void extract(const WaterfallData<double>& data, Result& result);
+
+    std::thread             m_worker;
+    std::mutex              m_mutex; // protects the members below
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_idle;
+    bool                    m_stop = false;
+    bool                    m_busy = false;
+
+    const WaterfallData<double>* m_data = nullptr;
+    bool     m_pending = false;
+    size_t   m_row = 0;
+    size_t   m_col = 0;
+    uint64_t m_requestGeneration = 0;
+
+    Result m_ready;
+    bool   m_hasReady = false;
+
+    std::atomic<uint64_t> m_generation;
+
+private:
+    Q_DISABLE_COPY(WaterfallCurveExtractor)
+};
+
+#endif // WATERFALLCURVEEXTRACTOR_H
@@ -2,8 +2,19 @@
 #define WATERFALLDATA_H
 
 #include <qwt_matrix_raster_data.h>
+#include <qwt_scale_map.h>
 
+#include <QReadWriteLock>
+
+#include <algorithm>
 #include <ctime>
+#include <vector>
+
+#include "WaterfallDetector.h"
+#include "WaterfallKernels.h"
+#include "WaterfallStatistics.h"
+#include "WaterfallTilePool.h"
+#include "WaterfallTraces.h"
 
 template <class T>
 class WaterfallData : public QwtMatrixRasterData
@@ -11,43 +22,144 @@ class WaterfallData : public QwtMatrixRasterData
     static_assert(std::is_arithmetic<T>::value, "WaterfallData's data must be numeric !");
 
 public:
+    // how layers whose length differs from the layer points are added (see rebin())
+    enum RebinMode
+    {
+        NoRebin,   // they are rejected
+        RebinMax,  // max-preserving decimation or linear upsampling
+        RebinMean  // mean decimation or linear upsampling
+    };
+
+    /* Zero-copy window of the history returned by view(): up to two strided
+     * segments (the ring buffer may wrap) pointing straight into the storage.
+     * The view doesn't pin the storage, its rows are only read through read()
+     * which holds the data's read lock for a short while (a chunk of rows):
+     * the layers added since the view was taken overwrite its oldest rows, and
+     * resize() or clear() make it stale. The data must outlive the view. */
+    class View
+    {
+    public:
+        struct Segment
+        {
+            const T*      data = nullptr;       // first value of the segment
+            size_t        rows = 0;
+            size_t        stride = 0;           // elements between two rows
+            const time_t* timestamps = nullptr; // one per row
+        };
+
+        bool isValid() const { return m_rows > 0 && m_cols > 0; }
+        size_t rows() const { return m_rows; }
+        size_t cols() const { return m_cols; }
+        size_t filledRows() const { return m_filledRows; } // rows holding a layer: the last ones
+        double offset() const { return m_offset; }         // Y of the first row of the history
+
+        size_t segmentCount() const { return m_segmentCount; }
+        const Segment& segment(const size_t i) const { return m_segments[i]; }
+
+        /* Pins the storage (addData(), resize() and clear() wait, keep fn short) and calls
+         * fn(first) to read the rows [first, rowEnd[: the rows of [rowBegin, rowEnd[ that
+         * still hold the layer they held when the view was taken. Returns false without
+         * calling fn if the data was resized or cleared since. */
+        template <class Fn>
+        bool read(const size_t rowBegin, const size_t rowEnd, Fn fn) const
+        {
+            if (!m_source)
+            {
+                return false;
+            }
+
+            QReadLocker locker(&m_source->m_lock);
+            if (m_source->m_layout != m_layout)
+            {
+                return false;
+            }
+
+            // each layer added overwrote the oldest row of the history
+            const double added = m_source->m_offset - m_offset;
+            const size_t overwritten = size_t(std::max(added, 0.));
+            const size_t first = (overwritten > m_rowBegin) ? overwritten - m_rowBegin : 0;
+            fn(std::min(std::max(first, rowBegin), rowEnd));
+            return true;
+        }
+
+        // row of the view (0: oldest), cols() values, only within read()
+        const T* row(const size_t r) const
+        {
+            return (r < m_segments[0].rows) ? m_segments[0].data + r * m_segments[0].stride
+                                            : m_segments[1].data + (r - m_segments[0].rows) * m_segments[1].stride;
+        }
+        T at(const size_t r, const size_t c) const { return row(r)[c]; }
+        time_t timestamp(const size_t r) const
+        {
+            return (r < m_segments[0].rows) ? m_segments[0].timestamps[r]
+                                            : m_segments[1].timestamps[r - m_segments[0].rows];
+        }
+
+    private:
+        friend class WaterfallData;
+
+        const WaterfallData* m_source = nullptr;
+        size_t               m_layout = 0; // m_layout of the source when the view was taken
+        double               m_offset = 0.;
+        size_t               m_rowBegin = 0; // history row of the first row
+        Segment              m_segments[2];
+        size_t               m_segmentCount = 0;
+        size_t               m_rows = 0;
+        size_t               m_cols = 0;
+        size_t               m_filledRows = 0;
+    };
+
     WaterfallData(double dXMin, double dXMax, // X bounds
                   const size_t historyExtent, // will define Y width
                   const size_t layerPoints) :
         m_data(new T[historyExtent * layerPoints]),
+        m_capacity(historyExtent * layerPoints),
+        m_head(0),
         m_offset(0),
         m_layerPoints(layerPoints),
         m_maxHistoryLength(historyExtent),
         m_currentHistoryLength(0),
-        m_layersTimestamps(new time_t[historyExtent])
+        m_layersTimestamps(new time_t[historyExtent]),
+        m_timestampsCapacity(historyExtent)
     {
-        if (m_layerPoints == 0 || m_maxHistoryLength == 0)
-        {
-            throw "Bad usage of WaterfallData !"; // better: call abort();
-        }
-
-        // initialize data with zeroes or the minimal value of T type
-        clear();
-
-        // sanitize
-        if (dXMin > dXMax)
-        {
-            std::swap(dXMin, dXMax);
-        }
-
-        m_xMin = dXMin;
-        m_xMax = dXMax;
+        init(dXMin, dXMax);
+    }
 
-        setInterval(Qt::XAxis,
-                    QwtInterval(dXMin, dXMax, QwtInterval::ExcludeMaximum));
-        setInterval(Qt::YAxis,
-                    QwtInterval(m_offset, m_maxHistoryLength + m_offset, QwtInterval::ExcludeMaximum));
+    /* Layers stored in an external buffer of historyExtent * layerPoints values and
+     * historyExtent timestamps (e.g. a slice of a WaterfallChannels allocation), which
+     * must outlive the data. They aren't freed, resize() beyond them moves the data to
+     * its own storage.
+     * With historyLength > 0, the buffer already holds a history (oldest row first, the
+     * filled rows last, e.g. a mapped session file): it's adopted as is, not cleared,
+     * and the Y axis starts at offset. */
+    WaterfallData(double dXMin, double dXMax,
+                  const size_t historyExtent,
+                  const size_t layerPoints,
+                  T* const storage,
+                  time_t* const timestamps,
+                  const size_t historyLength = 0,
+                  const double offset = 0) :
+        m_data(storage),
+        m_capacity(historyExtent * layerPoints),
+        m_head(0),
+        m_offset(offset),
+        m_layerPoints(layerPoints),
+        m_maxHistoryLength(historyExtent),
+        m_currentHistoryLength(std::min(historyLength, historyExtent)),
+        m_layersTimestamps(timestamps),
+        m_timestampsCapacity(historyExtent),
+        m_ownsStorage(false)
+    {
+        init(dXMin, dXMax, m_currentHistoryLength == 0);
     }
 
     ~WaterfallData() override
     {
-        delete [] m_data;
-        delete [] m_layersTimestamps;
+        if (m_ownsStorage)
+        {
+            delete [] m_data;
+            delete [] m_layersTimestamps;
+        }
     }
 
     // overriden methods
@@ -67,7 +179,24 @@ public:
         double dy = yInterval.width() / m_maxHistoryLength;
 
         int row = int((y - yInterval.minValue()) / dy);
-        int col = int((x - xInterval.minValue()) / dx);
+        int col;
+
+        if (m_binEdges.empty())
+        {
+            col = int((x - xInterval.minValue()) / dx);
+        }
+        else if (m_rasterActive)
+        {
+            // non-uniform bins: column lookup in the pixel map built by initRaster,
+            // x is the sample of a pixel (xMap.invTransform(pixel)), the map gives the pixel back
+            int pixel = qRound(m_rasterXMap.transform(x));
+            pixel = qBound(0, pixel, int(m_pixelToBin.size()) - 1);
+            col = int(m_pixelToBin[pixel]);
+        }
+        else
+        {
+            col = int(getColumn(x));
+        }
 
         if (row >= m_maxHistoryLength)
         {
@@ -78,7 +207,59 @@ public:
             col = m_layerPoints - 1;
         }
 
-        return double(m_data[row * m_layerPoints + col]);
+        return double(getLayer(row)[col]);
+    }
+
+    /* X scale map of the next raster, mapped to the image (pixel 0: first column) like
+       the maps of QwtPlotSpectrogram::renderImage(). With non-uniform bins, the pixel to
+       bin table is built from it, so non-linear maps (e.g. a logarithmic X axis) get a
+       bin per pixel. Without it, the area is mapped linearly to the raster. */
+    void setRasterXMap(const QwtScaleMap& xMap)
+    {
+        m_rasterXMap = xMap;
+        m_rasterXMapSet = true;
+    }
+
+    /* Called before rendering a raster of the area, with non-uniform bins
+       the pixel to bin table is only rebuilt when the X map or the raster
+       size changed (zoom, pan, resize or axis transformation). */
+    void initRaster(const QRectF& area, const QSize& raster) override
+    {
+        QwtMatrixRasterData::initRaster(area, raster);
+
+        if (m_binEdges.empty() || raster.width() <= 0 || area.width() <= 0)
+        {
+            return;
+        }
+
+        if (!m_rasterXMapSet)
+        {
+            m_rasterXMap = QwtScaleMap();
+            m_rasterXMap.setScaleInterval(area.left(), area.right());
+            m_rasterXMap.setPaintInterval(0, raster.width());
+        }
+
+        const double key[5] = { m_rasterXMap.s1(), m_rasterXMap.s2(), m_rasterXMap.p1(), m_rasterXMap.p2(),
+                                m_rasterXMap.transformation() ? 1. : 0. };
+        if (!std::equal(key, key + 5, m_rasterKey) || size_t(raster.width()) != m_pixelToBin.size())
+        {
+            std::copy(key, key + 5, m_rasterKey);
+
+            // the raster is sampled at each pixel index (see QwtPlotSpectrogram::renderTile())
+            m_pixelToBin.resize(raster.width());
+            for (int pixel = 0; pixel < raster.width(); ++pixel)
+            {
+                m_pixelToBin[pixel] = getColumn(m_rasterXMap.invTransform(pixel));
+            }
+        }
+        m_rasterActive = true;
+    }
+
+    void discardRaster() override
+    {
+        m_rasterActive = false;
+        m_rasterXMapSet = false;
+        QwtMatrixRasterData::discardRaster();
     }
 
     /* pixelHint() returns the geometry of a pixel, that can be used
@@ -98,7 +279,7 @@ public:
         Q_UNUSED(area)
 
         QRectF rect;
-        if (resampleMode() == NearestNeighbour)
+        if (resampleMode() == NearestNeighbour && m_binEdges.empty())
         {
             const QwtInterval intervalX = interval(Qt::XAxis);
             const QwtInterval intervalY = interval(Qt::YAxis);
@@ -115,28 +296,37 @@ public:
         return rect;
     }
 
-    bool addData(const T* const fftData, const size_t length, const time_t timestamp)
+    bool addData(const T* const data, const size_t length, const time_t timestamp)
     {
-        if (length != m_layerPoints)
+        QWriteLocker locker(&m_lock); // View::read() pins the storage
+
+        const T* const fftData = rebin(data, length);
+        if (!fftData)
         {
             return false;
         }
 
-        // another solution is to use move_backward and use m_currentHistoryLength
-        // the only benefit is to move only the filled layers
-        // and not all the waterfall layers - 1 when this last is not completely filled !
-        std::move(m_data + m_layerPoints,
-                  m_data + m_layerPoints + (m_maxHistoryLength - 1) * m_layerPoints,
-                  m_data);
+        // traces are updated before the oldest layer is overwritten as it may
+        // still be part of their sliding window
+        if (m_traces.isEnabled())
+        {
+            m_traces.update(fftData, m_layerPoints, m_currentHistoryLength,
+                            [this](const size_t row) { return getLayer(row); },
+                            m_maxHistoryLength);
+        }
 
-        std::copy(fftData, fftData + length, &m_data[m_layerPoints * (m_maxHistoryLength - 1)]);
+        if (m_statistics.isEnabled())
+        {
+            const T* const evicted = (m_currentHistoryLength == m_maxHistoryLength) ? getLayer(0) : nullptr;
+            m_statistics.update(fftData, evicted, m_layerPoints);
+        }
 
-        // do the same for the array of timestamps !
-        std::move(m_layersTimestamps + 1,
-                  m_layersTimestamps + 1 + (m_maxHistoryLength - 1),
-                  m_layersTimestamps);
+        // the storage is a ring buffer: the new layer overwrites the oldest one
+        // (m_head) which then becomes the newest one
+        std::copy(fftData, fftData + m_layerPoints, &m_data[m_layerPoints * m_head]);
+        m_layersTimestamps[m_head] = timestamp;
 
-        m_layersTimestamps[m_maxHistoryLength - 1] = timestamp;
+        m_head = (m_head + 1) % m_maxHistoryLength;
 
         if (m_currentHistoryLength < m_maxHistoryLength)
         {
@@ -147,16 +337,197 @@ public:
         setInterval(Qt::YAxis,
                     QwtInterval(m_offset, m_maxHistoryLength + m_offset, QwtInterval::ExcludeMaximum));
 
+        if (m_detector.isEnabled())
+        {
+            m_detector.evictBefore(m_offset);
+            m_detector.detect(fftData, m_layerPoints,
+                              m_statistics.isEnabled() ? &m_statistics : nullptr,
+                              m_offset + m_maxHistoryLength - 1, timestamp);
+        }
+
+        return true;
+    }
+
+    /* Changes the dimensions while preserving the history: the newest layers
+     * that fit in the new history are kept and resampled (in parallel) from the
+     * old X bins to the new ones, bins outside the old X bounds are zeroed.
+     * The storage is reused when its capacity allows it, when only the history
+     * length changes the layers are moved in place (no copy of the history).
+     * Non-uniform bins are reset to uniform ones and detected events are dropped. */
+    bool resize(double dXMin, double dXMax,
+                const size_t historyExtent,
+                const size_t layerPoints)
+    {
+        if (layerPoints == 0 || historyExtent == 0)
+        {
+            return false;
+        }
+        if (dXMin > dXMax)
+        {
+            std::swap(dXMin, dXMax);
+        }
+
+        QWriteLocker locker(&m_lock);
+        ++m_layout; // views are stale
+
+        const size_t kept = std::min(m_currentHistoryLength, historyExtent);
+        const size_t firstRow = m_maxHistoryLength - kept; // oldest kept layer
+        const size_t keptRow = historyExtent - kept;       // its row in the new history
+        const bool sameBins = (layerPoints == m_layerPoints && dXMin == m_xMin &&
+                               dXMax == m_xMax && m_binEdges.empty());
+        const size_t size = historyExtent * layerPoints;
+        // an external storage can't grow: the data moves to its own
+        const bool migrate = !m_ownsStorage && (size > m_capacity || historyExtent > m_timestampsCapacity);
+        const bool reuse = (size <= m_capacity && !migrate);
+
+        std::vector<time_t> timestamps(kept);
+        for (size_t i = 0; i < kept; ++i)
+        {
+            timestamps[i] = getLayerDate(firstRow + i);
+        }
+
+        if (reuse && sameBins)
+        {
+            // 1. in place: the ring is unrolled (oldest layer first), then the kept
+            // layers are moved to the end of the new history
+            std::rotate(m_data, m_data + m_head * m_layerPoints, m_data + m_maxHistoryLength * m_layerPoints);
+            T* const from = m_data + firstRow * layerPoints;
+            T* const to = m_data + keptRow * layerPoints;
+            if (to < from)
+            {
+                std::copy(from, from + kept * layerPoints, to);
+            }
+            else
+            {
+                std::copy_backward(from, from + kept * layerPoints, to + kept * layerPoints);
+            }
+        }
+        else
+        {
+            // 1. resample the kept layers (oldest first), straight into the new storage
+            // or into a copy when the current one is reused
+            T* const storage = (reuse) ? nullptr : new T[size];
+            std::vector<T> layers((reuse) ? kept * layerPoints : 0);
+            T* const out = (reuse) ? layers.data() : storage + keptRow * layerPoints;
+            const size_t chunkRows = 16;
+            WaterfallTilePool::instance().run((kept + chunkRows - 1) / chunkRows, [&](const size_t chunk)
+            {
+                const size_t end = std::min((chunk + 1) * chunkRows, kept);
+                for (size_t i = chunk * chunkRows; i < end; ++i)
+                {
+                    const T* const layer = getLayer(firstRow + i);
+                    if (sameBins)
+                    {
+                        std::copy(layer, layer + layerPoints, out + i * layerPoints);
+                    }
+                    else
+                    {
+                        resampleLayer(layer, out + i * layerPoints, dXMin, dXMax, layerPoints);
+                    }
+                }
+            });
+
+            // 2. reuse or replace the storage
+            if (reuse)
+            {
+                std::copy(layers.cbegin(), layers.cend(), m_data + keptRow * layerPoints);
+            }
+            else
+            {
+                if (m_ownsStorage)
+                {
+                    delete [] m_data;
+                }
+                m_data = storage;
+                m_capacity = size;
+            }
+        }
+        if (historyExtent > m_timestampsCapacity || migrate)
+        {
+            if (m_ownsStorage)
+            {
+                delete [] m_layersTimestamps;
+            }
+            m_layersTimestamps = new time_t[historyExtent];
+            m_timestampsCapacity = historyExtent;
+        }
+        m_ownsStorage = m_ownsStorage || migrate;
+
+        m_layerPoints = layerPoints;
+        m_maxHistoryLength = historyExtent;
+        m_xMin = dXMin;
+        m_xMax = dXMax;
+        assignBinEdges(std::vector<double>());
+        setInterval(Qt::XAxis, QwtInterval(m_xMin, m_xMax, QwtInterval::ExcludeMaximum));
+
+        // 3. the layers are at the end of the history, the rows before are emptied, the offset is kept
+        std::fill(m_data, m_data + keptRow * m_layerPoints, T(0));
+        std::fill(m_layersTimestamps, m_layersTimestamps + keptRow, 0);
+        std::copy(timestamps.cbegin(), timestamps.cend(), m_layersTimestamps + keptRow);
+        m_head = 0;
+        m_currentHistoryLength = kept;
+        setInterval(Qt::YAxis,
+                    QwtInterval(m_offset, m_maxHistoryLength + m_offset, QwtInterval::ExcludeMaximum));
+
+        m_traces.reset();
+        m_detector.clear();
+        if (m_statistics.isEnabled())
+        {
+            setStatisticsEnabled(true, m_statistics.getSketchMin(), m_statistics.getSketchMax(),
+                                 m_statistics.getSketchBins());
+        }
+
         return true;
     }
 
+    void setRebinMode(const RebinMode mode) { m_rebinMode = mode; }
+    RebinMode getRebinMode() const { return m_rebinMode; }
+
+    /* Resamples a layer of any length covering the X bounds to the layer points.
+     * Returns data itself when no resampling is needed, an internal buffer
+     * (valid until the next call) otherwise or nullptr if the layer can't be used. */
+    const T* rebin(const T* const data, const size_t length)
+    {
+        if (length == m_layerPoints)
+        {
+            return data;
+        }
+        if (m_rebinMode == NoRebin || length == 0 || !data)
+        {
+            return nullptr;
+        }
+
+        m_rebinLayer.resize(m_layerPoints);
+        if (length < m_layerPoints)
+        {
+            WaterfallKernels::interpolateLinear(m_rebinLayer.data(), m_layerPoints, data, length);
+        }
+        else if (m_rebinMode == RebinMax)
+        {
+            WaterfallKernels::decimateMax(m_rebinLayer.data(), m_layerPoints, data, length);
+        }
+        else
+        {
+            WaterfallKernels::decimateMean(m_rebinLayer.data(), m_layerPoints, data, length);
+        }
+        return m_rebinLayer.data();
+    }
+
     void clear()
     {
+        QWriteLocker locker(&m_lock);
+        ++m_layout; // views are stale
+
         std::fill(m_data, m_data + m_layerPoints * m_maxHistoryLength, 0.);
         m_currentHistoryLength = 0;
 
         std::fill(m_layersTimestamps, m_layersTimestamps + m_maxHistoryLength, 0);
 
+        m_traces.reset();
+        m_statistics.reset();
+        m_detector.clear();
+
+        m_head = 0;
         m_offset = 0;
         setInterval(Qt::YAxis,
                     QwtInterval(0, m_maxHistoryLength, QwtInterval::ExcludeMaximum));
@@ -188,11 +559,25 @@ public:
     {
         if (m_currentHistoryLength > 0)
         {
-            auto resultPair = std::minmax_element(
-                m_data + (m_maxHistoryLength - m_currentHistoryLength) * m_layerPoints,
-                m_data + m_layerPoints * m_maxHistoryLength);
-            rangeMin = double(*resultPair.first);
-            rangeMax = double(*resultPair.second);
+            // filled layers are at most two contiguous segments of the ring buffer
+            const size_t first = (m_head + m_maxHistoryLength - m_currentHistoryLength) % m_maxHistoryLength;
+            const size_t firstCount = std::min(m_currentHistoryLength, m_maxHistoryLength - first);
+
+            auto resultPair = std::minmax_element(m_data + first * m_layerPoints,
+                                                  m_data + (first + firstCount) * m_layerPoints);
+            T dataMin = *resultPair.first;
+            T dataMax = *resultPair.second;
+
+            if (firstCount < m_currentHistoryLength)
+            {
+                resultPair = std::minmax_element(m_data,
+                                                 m_data + (m_currentHistoryLength - firstCount) * m_layerPoints);
+                dataMin = std::min(dataMin, *resultPair.first);
+                dataMax = std::max(dataMax, *resultPair.second);
+            }
+
+            rangeMin = double(dataMin);
+            rangeMax = double(dataMax);
         }
         else
         {
@@ -207,30 +592,308 @@ public:
         const size_t index = y;
         if (index < m_maxHistoryLength)
         {
-            return m_layersTimestamps[index];
+            return m_layersTimestamps[(m_head + index) % m_maxHistoryLength];
         }
         return 0;
     }
 
+    // layer at history row 'row' (0: oldest, getMaxHistoryLength() - 1: newest)
+    const T* getLayer(const size_t row) const
+    {
+        return m_data + ((m_head + row) % m_maxHistoryLength) * m_layerPoints;
+    }
+
+    /* View of the history rows [rowBegin, rowEnd[ (0: oldest, getMaxHistoryLength() - 1:
+     * newest, like getLayer()) and the bins [colBegin, colEnd[, clamped to the data.
+     * The rows of the view keep their order (oldest first) across the two segments. */
+    View view(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd) const
+    {
+        View result;
+        QReadLocker locker(&m_lock); // only while the segments are computed
+
+        rowEnd = std::min(rowEnd, m_maxHistoryLength);
+        colEnd = std::min(colEnd, m_layerPoints);
+        if (rowBegin >= rowEnd || colBegin >= colEnd)
+        {
+            return result;
+        }
+
+        result.m_source = this;
+        result.m_layout = m_layout;
+        result.m_offset = m_offset;
+        result.m_rowBegin = rowBegin;
+        result.m_rows = rowEnd - rowBegin;
+        result.m_cols = colEnd - colBegin;
+        const size_t firstFilled = m_maxHistoryLength - m_currentHistoryLength;
+        result.m_filledRows = rowEnd - std::max(rowBegin, std::min(firstFilled, rowEnd));
+
+        const size_t first = (m_head + rowBegin) % m_maxHistoryLength;
+        const size_t firstCount = std::min(result.m_rows, m_maxHistoryLength - first);
+
+        typename View::Segment& segment = result.m_segments[0];
+        segment.data = m_data + first * m_layerPoints + colBegin;
+        segment.rows = firstCount;
+        segment.stride = m_layerPoints;
+        segment.timestamps = m_layersTimestamps + first;
+        result.m_segmentCount = 1;
+
+        if (firstCount < result.m_rows)
+        {
+            // wrapped: the remaining rows start at the beginning of the storage
+            typename View::Segment& wrapped = result.m_segments[1];
+            wrapped.data = m_data + colBegin;
+            wrapped.rows = result.m_rows - firstCount;
+            wrapped.stride = m_layerPoints;
+            wrapped.timestamps = m_layersTimestamps;
+            result.m_segmentCount = 2;
+        }
+        return result;
+    }
+
+    // raw ring buffer storage: the oldest layer is at index getHead() (prefer view())
     const T* getData() const { return m_data; }
     const time_t* getTimes() const { return m_layersTimestamps; }
+    size_t getHead() const { return m_head; }
+
+    // max-hold, average and min-hold traces maintained during addData
+    WaterfallTraces<T>& traces() { return m_traces; }
+    const WaterfallTraces<T>& traces() const { return m_traces; }
+
+    /* per-column statistics over the rolling history (opt-in),
+     * the noise floor sketch is a histogram of sketchBins bins per column covering
+     * [sketchMin, sketchMax]: its resolution is (sketchMax - sketchMin) / sketchBins */
+    void setStatisticsEnabled(const bool enabled,
+                              const double sketchMin = 0.,
+                              const double sketchMax = 1.,
+                              const size_t sketchBins = 64)
+    {
+        m_statistics.setEnabled(enabled);
+        if (!enabled)
+        {
+            return;
+        }
+
+        // catch up with the layers already in the history
+        m_statistics.setup(m_layerPoints, sketchMin, sketchMax, sketchBins);
+        for (size_t row = m_maxHistoryLength - m_currentHistoryLength; row < m_maxHistoryLength; ++row)
+        {
+            m_statistics.insert(getLayer(row));
+        }
+    }
+    const WaterfallStatistics<T>& statistics() const { return m_statistics; }
+
+    // threshold/noise floor events detector run on each new layer
+    WaterfallDetector<T>& detector() { return m_detector; }
+    const WaterfallDetector<T>& detector() const { return m_detector; }
 
     double getXMin() const { return m_xMin; }
     double getXMax() const { return m_xMax; }
 
+    /* Non-uniform bins (e.g. log-frequency or FFT bins with arbitrary center
+       frequencies): edges must contain getLayerPoints() + 1 ascending values,
+       X bounds become the first and last edges. An empty array restores the
+       uniform bins of the X bounds. */
+    bool setBinEdges(const std::vector<double>& edges)
+    {
+        QWriteLocker locker(&m_lock); // read with the storage by views (e.g. session snapshots)
+        return assignBinEdges(edges);
+    }
+    const std::vector<double>& getBinEdges() const { return m_binEdges; }
+
+    // left edge of a bin, i = getLayerPoints() gives the right edge of the last one
+    double getBinEdge(const size_t i) const
+    {
+        if (!m_binEdges.empty())
+        {
+            return m_binEdges[std::min(i, m_layerPoints)];
+        }
+        return m_xMin + i * (m_xMax - m_xMin) / m_layerPoints;
+    }
+
+    // X coordinate of the center of a bin
+    double getBinCenter(const size_t col) const
+    {
+        return (getBinEdge(col) + getBinEdge(col + 1)) / 2;
+    }
+
+    // bin containing x (clamped to the X bounds)
+    size_t getColumn(const double x) const
+    {
+        size_t col;
+        if (m_binEdges.empty())
+        {
+            const double pos = (x - m_xMin) * m_layerPoints / (m_xMax - m_xMin);
+            col = (pos > 0) ? size_t(pos) : 0;
+        }
+        else
+        {
+            const auto it = std::upper_bound(m_binEdges.cbegin(), m_binEdges.cend(), x);
+            col = (it == m_binEdges.cbegin()) ? 0 : size_t(it - m_binEdges.cbegin()) - 1;
+        }
+        return std::min(col, m_layerPoints - 1);
+    }
+
     double getOffset() const { return m_offset; }
 
+    // bytes allocated by the storage and the analysis buffers (approximation)
+    size_t getMemoryUsage() const
+    {
+        // an external storage is accounted by its owner
+        return (m_ownsStorage ? m_capacity * sizeof(T) + m_timestampsCapacity * sizeof(time_t) : 0) +
+               m_rebinLayer.capacity() * sizeof(T) +
+               m_binEdges.capacity() * sizeof(double) +
+               m_pixelToBin.capacity() * sizeof(size_t) +
+               m_traces.size() * 4 * sizeof(double) +
+               m_statistics.size() * (4 * sizeof(double) + m_statistics.getSketchBins() * sizeof(unsigned)) +
+               m_detector.events().size() * sizeof(WaterfallEvent);
+    }
+
 protected:
-    T* const     m_data;
+    bool assignBinEdges(const std::vector<double>& edges)
+    {
+        if (!edges.empty())
+        {
+            if (edges.size() != m_layerPoints + 1 ||
+                std::adjacent_find(edges.cbegin(), edges.cend(),
+                                   [](const double a, const double b) { return !(a < b); }) != edges.cend())
+            {
+                return false;
+            }
+
+            m_xMin = edges.front();
+            m_xMax = edges.back();
+            setInterval(Qt::XAxis, QwtInterval(m_xMin, m_xMax, QwtInterval::ExcludeMaximum));
+        }
+
+        m_binEdges = edges;
+        m_pixelToBin.clear();
+        m_rasterActive = false;
+        return true;
+    }
+
+    void init(double dXMin, double dXMax, const bool clearStorage = true)
+    {
+        if (m_layerPoints == 0 || m_maxHistoryLength == 0)
+        {
+            throw "Bad usage of WaterfallData !"; // better: call abort();
+        }
+
+        // initialize data with zeroes or the minimal value of T type
+        if (clearStorage)
+        {
+            clear();
+        }
+
+        // sanitize
+        if (dXMin > dXMax)
+        {
+            std::swap(dXMin, dXMax);
+        }
+
+        m_xMin = dXMin;
+        m_xMax = dXMax;
+
+        setInterval(Qt::XAxis,
+                    QwtInterval(dXMin, dXMax, QwtInterval::ExcludeMaximum));
+        setInterval(Qt::YAxis,
+                    QwtInterval(m_offset, m_maxHistoryLength + m_offset, QwtInterval::ExcludeMaximum));
+    }
+
+    /* resamples a layer from the current X bins to layerPoints uniform bins
+       in [dXMin, dXMax], with the rebin mode when several old bins are merged
+       (mean by default) and a linear interpolation otherwise */
+    void resampleLayer(const T* const layer, T* const out,
+                       const double dXMin, const double dXMax, const size_t layerPoints) const
+    {
+        const double dx = (dXMax - dXMin) / layerPoints;
+        for (size_t i = 0; i < layerPoints; ++i)
+        {
+            const double x0 = dXMin + i * dx;
+            const double x1 = x0 + dx;
+            if (x1 <= m_xMin || x0 >= m_xMax)
+            {
+                out[i] = T(0);
+                continue;
+            }
+
+            const size_t colBegin = getColumn(x0);
+            const size_t colEnd = getColumn(x1 - dx * 1e-9);
+            if (colEnd > colBegin)
+            {
+                if (m_rebinMode == RebinMax)
+                {
+                    out[i] = *std::max_element(layer + colBegin, layer + colEnd + 1);
+                }
+                else
+                {
+                    double sum = 0.;
+                    for (size_t col = colBegin; col <= colEnd; ++col)
+                    {
+                        sum += double(layer[col]);
+                    }
+                    out[i] = T(sum / (colEnd - colBegin + 1));
+                }
+                continue;
+            }
+
+            // a single old bin: interpolate between its center and its closest neighbour's one
+            const double x = (x0 + x1) / 2;
+            const double center = getBinCenter(colBegin);
+            size_t other = colBegin;
+            if (x > center && colBegin + 1 < m_layerPoints)
+            {
+                other = colBegin + 1;
+            }
+            else if (x < center && colBegin > 0)
+            {
+                other = colBegin - 1;
+            }
+
+            if (other == colBegin)
+            {
+                out[i] = layer[colBegin];
+            }
+            else
+            {
+                const double otherCenter = getBinCenter(other);
+                const double t = (x - center) / (otherCenter - center);
+                out[i] = T(double(layer[colBegin]) + t * (double(layer[other]) - double(layer[colBegin])));
+            }
+        }
+    }
+
+    T*           m_data;
+    size_t       m_capacity;             // allocated elements in m_data
+    size_t       m_head;                 // ring buffer index of the oldest layer
     double       m_offset;
-    const size_t m_layerPoints;          // fft points
-    const size_t m_maxHistoryLength;     // max number of layers (Y width)
+    size_t       m_layerPoints;          // fft points
+    size_t       m_maxHistoryLength;     // max number of layers (Y width)
     size_t       m_currentHistoryLength; // filled layers count
 
-    time_t* const m_layersTimestamps;
+    time_t* m_layersTimestamps;
+    size_t  m_timestampsCapacity;
+    bool    m_ownsStorage = true; // false: external storage
+
+    mutable QReadWriteLock m_lock;       // held for reading by View::read()
+    size_t                 m_layout = 0; // changed by resize() and clear(): the views are stale
 
     double m_xMin;
     double m_xMax;
+
+    RebinMode      m_rebinMode = NoRebin;
+    std::vector<T> m_rebinLayer;
+
+    // non-uniform bins
+    std::vector<double> m_binEdges;
+    std::vector<size_t> m_pixelToBin;
+    QwtScaleMap         m_rasterXMap;       // pixel <-> x of the current raster
+    double              m_rasterKey[5] = {}; // map of the pixel to bin table
+    bool                m_rasterXMapSet = false;
+    bool                m_rasterActive = false;
+
+    WaterfallTraces<T>     m_traces;
+    WaterfallStatistics<T> m_statistics;
+    WaterfallDetector<T>   m_detector;
 };
 
 #endif // WATERFALLDATA_H
@@ -0,0 +1,223 @@
+#ifndef WATERFALLDETECTOR_H
+#define WATERFALLDETECTOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <limits>
+#include <vector>
+
+#include "WaterfallStatistics.h"
+
+/* An event is a run of adjacent bins of a single layer above the threshold.
+ * layer is the Y coordinate of the layer in the waterfall (it doesn't change
+ * when new layers are added, see WaterfallData::getOffset()). */
+struct WaterfallEvent
+{
+    double layer;
+    time_t timestamp;
+    size_t colBegin; // first bin above the threshold
+    size_t colEnd;   // last bin above the threshold (included)
+    size_t peakCol;
+    double peak;
+};
+
+/* Detector run on each incoming layer (WaterfallData::addData path).
+ * A bin is a hit when its value is above an absolute threshold and/or more than
+ * 'margin' above the noise floor (e.g. X dB for dB data). Hits are computed with
+ * a branchless compare-and-mask pass and adjacent hits (separated by at most
+ * 'mergeGap' bins) are merged into events, stored in ascending layer order so
+ * that the events of a window can be found with a binary search.
+ */
+template <class T>
+class WaterfallDetector
+{
+public:
+    void setEnabled(const bool enabled) { m_enabled = enabled; }
+    bool isEnabled() const { return m_enabled; }
+
+    void setThreshold(const bool enabled, const double threshold)
+    {
+        m_useThreshold = enabled;
+        m_threshold = threshold;
+        m_thresholdsDirty = true;
+    }
+
+    // requires the statistics (noise floor estimate) of WaterfallData
+    void setNoiseFloorMargin(const bool enabled, const double margin)
+    {
+        m_useNoiseFloor = enabled;
+        m_margin = margin;
+        m_thresholdsDirty = true;
+    }
+
+    // the noise floor is only read every 'layers' layers as it is costly to estimate
+    void setNoiseFloorRefreshInterval(const size_t layers)
+    {
+        m_floorRefreshInterval = std::max(layers, size_t(1));
+    }
+
+    void setMergeGap(const size_t bins) { m_mergeGap = bins; }
+    void setMaxEvents(const size_t count) { m_maxEvents = count; }
+
+    bool usesNoiseFloor() const { return m_useNoiseFloor; }
+
+    void clear()
+    {
+        m_events.clear();
+        m_thresholdsDirty = true;
+    }
+
+    /* statistics may be null if the noise floor isn't available
+     * returns the number of new events */
+    size_t detect(const T* const layer, const size_t length,
+                  const WaterfallStatistics<T>* const statistics,
+                  const double layerY, const time_t timestamp)
+    {
+        const bool useFloor = m_useNoiseFloor && statistics &&
+                              statistics->count() > 0 && statistics->size() == length;
+        if (!m_useThreshold && !useFloor)
+        {
+            return 0;
+        }
+
+        updateThresholds(length, useFloor ? statistics : nullptr);
+
+        // compare-and-mask
+        m_mask.resize(length);
+        const double* const thresholds = m_thresholds.data();
+        uint8_t* const mask = m_mask.data();
+        for (size_t i = 0; i < length; ++i)
+        {
+            mask[i] = uint8_t(double(layer[i]) > thresholds[i]);
+        }
+
+        // merge adjacent hits into events
+        size_t newEvents = 0;
+        size_t i = 0;
+        while (i < length)
+        {
+            const uint8_t* const hit = std::find(mask + i, mask + length, uint8_t(1));
+            if (hit == mask + length)
+            {
+                break;
+            }
+
+            WaterfallEvent event;
+            event.layer = layerY;
+            event.timestamp = timestamp;
+            event.colBegin = hit - mask;
+            event.colEnd = event.colBegin;
+            event.peakCol = event.colBegin;
+            event.peak = double(layer[event.colBegin]);
+
+            size_t gap = 0;
+            for (i = event.colBegin + 1; i < length && gap <= m_mergeGap; ++i)
+            {
+                if (!mask[i])
+                {
+                    ++gap;
+                    continue;
+                }
+                gap = 0;
+                event.colEnd = i;
+                if (double(layer[i]) > event.peak)
+                {
+                    event.peak = double(layer[i]);
+                    event.peakCol = i;
+                }
+            }
+            i = event.colEnd + 1;
+
+            m_events.push_back(event);
+            ++newEvents;
+        }
+
+        while (m_events.size() > m_maxEvents)
+        {
+            m_events.pop_front();
+        }
+
+        return newEvents;
+    }
+
+    // drop the events of the layers evicted from the history
+    void evictBefore(const double layerY)
+    {
+        m_events.erase(m_events.begin(), lowerBound(layerY));
+    }
+
+    const std::deque<WaterfallEvent>& events() const { return m_events; }
+
+    // events of the layers in [layerMin, layerMax]
+    typedef typename std::deque<WaterfallEvent>::const_iterator const_iterator;
+    std::pair<const_iterator, const_iterator> events(const double layerMin, const double layerMax) const
+    {
+        const const_iterator first = lowerBound(layerMin);
+        const const_iterator last = std::upper_bound(first, m_events.cend(), layerMax,
+                                                     [](const double y, const WaterfallEvent& e)
+                                                     { return y < e.layer; });
+        return std::make_pair(first, last);
+    }
+
+protected:
+    const_iterator lowerBound(const double layerY) const
+    {
+        return std::lower_bound(m_events.cbegin(), m_events.cend(), layerY,
+                                [](const WaterfallEvent& e, const double y)
+                                { return e.layer < y; });
+    }
+
+    void updateThresholds(const size_t length, const WaterfallStatistics<T>* const statistics)
+    {
+        const bool useFloor = (statistics != nullptr);
+        if (useFloor)
+        {
+            ++m_floorAge;
+        }
+        if (!m_thresholdsDirty && m_thresholds.size() == length &&
+            m_thresholdsFromFloor == useFloor &&
+            (!useFloor || m_floorAge < m_floorRefreshInterval))
+        {
+            return;
+        }
+
+        const double absolute = m_useThreshold ? m_threshold : -std::numeric_limits<double>::max();
+        m_thresholds.assign(length, absolute);
+        if (useFloor)
+        {
+            const double* const noiseFloor = statistics->noiseFloor();
+            double* const thresholds = m_thresholds.data();
+            for (size_t i = 0; i < length; ++i)
+            {
+                const double relative = noiseFloor[i] + m_margin;
+                thresholds[i] = (relative > thresholds[i]) ? relative : thresholds[i];
+            }
+        }
+
+        m_thresholdsFromFloor = useFloor;
+        m_thresholdsDirty = false;
+        m_floorAge = 0;
+    }
+
+    bool   m_enabled = false;
+    bool   m_useThreshold = false;
+    bool   m_useNoiseFloor = false;
+    double m_threshold = 0.;
+    double m_margin = 0.;
+    size_t m_mergeGap = 0;
+    size_t m_maxEvents = 100000;
+
+    size_t m_floorRefreshInterval = 16;
+    size_t m_floorAge = 0;
+
+    std::vector<double>  m_thresholds;
+    bool                 m_thresholdsFromFloor = false;
+    bool                 m_thresholdsDirty = true;
+    std::vector<uint8_t> m_mask;
+
+    std::deque<WaterfallEvent> m_events;
+};
+
+#endif // WATERFALLDETECTOR_H
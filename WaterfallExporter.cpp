@@ -0,0 +1,219 @@
+#include "WaterfallExporter.h"
+
+#include <QByteArray>
+#include <QSaveFile>
+
+#include <cstring>
+
+WaterfallExporter::WaterfallExporter(QObject* const parent /*= nullptr*/) :
+    QObject(parent),
+    m_running(false),
+    m_cancel(false)
+{
+    // queued from the worker: the data is released on this thread
+    connect(this, &WaterfallExporter::finished, this, &WaterfallExporter::join);
+}
+
+WaterfallExporter::~WaterfallExporter()
+{
+    cancel();
+    join();
+}
+
+bool WaterfallExporter::start(std::shared_ptr<const WaterfallData<double>> data, const QRectF& window,
+                              const QString& fileName, const Format format)
+{
+    if (m_running || !data)
+    {
+        return false;
+    }
+    join(); // previous export
+
+    m_cancel = false;
+    m_running = true;
+    m_data = std::move(data);
+
+    // the data is copied and written by the worker, the signals are queued to the receivers' thread
+    m_worker = std::thread([this, window, fileName, format]()
+    {
+        run(*m_data, window, fileName, format);
+    });
+
+    return true;
+}
+
+void WaterfallExporter::cancel()
+{
+    m_cancel = true;
+}
+
+void WaterfallExporter::join()
+{
+    if (m_worker.joinable())
+    {
+        m_worker.join();
+    }
+    m_data.reset();
+}
+
+void WaterfallExporter::run(const WaterfallData<double>& data, const QRectF& window,
+                            const QString& fileName, const Format format)
+{
+    QString error;
+    bool success;
+    WaterfallSnapshot snapshot;
+    if (!WaterfallExporter::snapshot(data, window, snapshot))
+    {
+        success = false;
+        error = "The data was resized or cleared during the export.";
+    }
+    else if (format == Csv)
+    {
+        success = writeCsv(snapshot, fileName, error);
+    }
+    else
+    {
+        success = writeMatrix(snapshot, fileName, format, error) &&
+                  writeTimestamps(snapshot, fileName + ".timestamps", error);
+    }
+
+    m_running = false;
+    emit finished(success, error);
+}
+
+bool WaterfallExporter::writeMatrix(const WaterfallSnapshot& snapshot, const QString& fileName,
+                                    const Format format, QString& error)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        error = file.errorString();
+        return false;
+    }
+
+    if (format == Npy)
+    {
+        // header padded with spaces so the data is 64 bytes aligned (format version 1.0)
+        QByteArray header = QString("{'descr': '<f8', 'fortran_order': False, 'shape': (%1, %2), }")
+                                .arg(snapshot.rows).arg(snapshot.cols).toLatin1();
+        const int preamble = 10;
+        const int padding = 64 - (preamble + header.size() + 1) % 64;
+        header.append(QByteArray(padding % 64, ' '));
+        header.append('\n');
+
+        const quint16 headerLength = quint16(header.size());
+        QByteArray magic("\x93NUMPY\x01\x00", 8);
+        magic.append(char(headerLength & 0xff));
+        magic.append(char(headerLength >> 8));
+        file.write(magic);
+        file.write(header);
+    }
+
+    // chunks of whole layers
+    const size_t layerBytes = std::max(snapshot.cols * sizeof(double), size_t(1));
+    const size_t chunkRows = std::max(m_chunkSize / layerBytes, size_t(1));
+    for (size_t row = 0; row < snapshot.rows; row += chunkRows)
+    {
+        if (m_cancel)
+        {
+            file.cancelWriting();
+            error = "Export cancelled.";
+            return false;
+        }
+
+        const size_t count = std::min(chunkRows, snapshot.rows - row);
+        const qint64 bytes = qint64(count * snapshot.cols * sizeof(double));
+        if (file.write(reinterpret_cast<const char*>(snapshot.values.data() + row * snapshot.cols), bytes) != bytes)
+        {
+            error = file.errorString();
+            file.cancelWriting();
+            return false;
+        }
+        emit progress(int(100 * (row + count) / snapshot.rows));
+    }
+
+    if (!file.commit())
+    {
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool WaterfallExporter::writeCsv(const WaterfallSnapshot& snapshot, const QString& fileName, QString& error)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        error = file.errorString();
+        return false;
+    }
+
+    QByteArray chunk;
+    chunk.reserve(int(std::min(m_chunkSize + m_chunkSize / 4, size_t(1) << 30)));
+
+    chunk.append("timestamp");
+    for (const double x : snapshot.xValues)
+    {
+        chunk.append(',');
+        chunk.append(QByteArray::number(x, 'g', 17));
+    }
+    chunk.append('\n');
+
+    for (size_t row = 0; row < snapshot.rows; ++row)
+    {
+        if (m_cancel)
+        {
+            file.cancelWriting();
+            error = "Export cancelled.";
+            return false;
+        }
+
+        chunk.append(QByteArray::number(snapshot.timestamps[row]));
+        const double* const layer = snapshot.values.data() + row * snapshot.cols;
+        for (size_t col = 0; col < snapshot.cols; ++col)
+        {
+            chunk.append(',');
+            chunk.append(QByteArray::number(layer[col], 'g', 17));
+        }
+        chunk.append('\n');
+
+        if (size_t(chunk.size()) >= m_chunkSize || row + 1 == snapshot.rows)
+        {
+            if (file.write(chunk) != chunk.size())
+            {
+                error = file.errorString();
+                file.cancelWriting();
+                return false;
+            }
+            chunk.clear();
+            emit progress(int(100 * (row + 1) / snapshot.rows));
+        }
+    }
+
+    if (!file.commit())
+    {
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool WaterfallExporter::writeTimestamps(const WaterfallSnapshot& snapshot, const QString& fileName, QString& error)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        error = file.errorString();
+        return false;
+    }
+
+    const qint64 bytes = qint64(snapshot.timestamps.size() * sizeof(qint64));
+    if (file.write(reinterpret_cast<const char*>(snapshot.timestamps.data()), bytes) != bytes ||
+        !file.commit())
+    {
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,184 @@
+#ifndef WATERFALLEXPORTER_H
+#define WATERFALLEXPORTER_H
+
+#include <QObject>
+#include <QRectF>
+#include <QString>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "WaterfallData.h"
+
+// copy of a window of the history (oldest layer first), can be handed to another thread
+struct WaterfallSnapshot
+{
+    size_t rows = 0;
+    size_t cols = 0;
+    std::vector<double> values;     // rows x cols
+    std::vector<qint64> timestamps; // one per row
+    std::vector<double> xValues;    // bin centers, one per column
+};
+
+/* Exports waterfall data to disk on a worker thread, so exporting a large
+ * history doesn't freeze the display. The worker first copies the data in a
+ * snapshot by chunks of rows (the data is pinned for each chunk only, see
+ * WaterfallData::View), then writes it by chunks, progress() being emitted
+ * after each one.
+ *
+ * Formats:
+ *  - Raw: float64 little endian matrix (layers x points) and a
+ *    "<fileName>.timestamps" file of int64 timestamps (qwtwaterfall-render input),
+ *  - Npy: NumPy array (float64, shape (layers, points)) and the same timestamps file,
+ *  - Csv: a "timestamp" column followed by a column per bin (bin centers in the header).
+ * Files are written through QSaveFile: a cancelled or failed export leaves no partial file.
+ */
+class WaterfallExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Format
+    {
+        Raw,
+        Npy,
+        Csv
+    };
+
+    explicit WaterfallExporter(QObject* const parent = nullptr);
+    ~WaterfallExporter() override;
+
+    /* Copies the layers and bins of data within window (X values, Y layers
+     * coordinates like the spectrogram, see WaterfallData::getOffset()),
+     * an invalid window selects the whole filled history. The oldest rows
+     * overwritten by layers added during the copy are left out, returns false
+     * if the data was resized or cleared meanwhile. */
+    template <class T>
+    static bool snapshot(const WaterfallData<T>& data, const QRectF& window, WaterfallSnapshot& snapshot);
+
+    /* Returns false if an export is already running. The data is kept alive
+     * until the export is over (e.g. an aliasing pointer to a WaterfallStore's data). */
+    bool start(std::shared_ptr<const WaterfallData<double>> data, const QRectF& window,
+               const QString& fileName, const Format format);
+    void cancel();
+    bool isRunning() const { return m_running; }
+
+    // bytes written per chunk
+    void setChunkSize(const size_t bytes) { m_chunkSize = std::max(bytes, size_t(4096)); }
+    size_t getChunkSize() const { return m_chunkSize; }
+
+signals:
+    void progress(const int percent);
+    void finished(const bool success, const QString& error);
+
+protected:
+    void run(const WaterfallData<double>& data, const QRectF& window, const QString& fileName, const Format format);
+    bool writeMatrix(const WaterfallSnapshot& snapshot, const QString& fileName, const Format format, QString& error);
+    bool writeCsv(const WaterfallSnapshot& snapshot, const QString& fileName, QString& error);
+    bool writeTimestamps(const WaterfallSnapshot& snapshot, const QString& fileName, QString& error);
+    void join();
+
+    std::thread                                  m_worker;
+    std::shared_ptr<const WaterfallData<double>> m_data; // released by join(), on the owner's thread
+    std::atomic<bool>                            m_running;
+    std::atomic<bool>                            m_cancel;
+    size_t                                       m_chunkSize = 4 * 1024 * 1024;
+
+private:
+    Q_DISABLE_COPY(WaterfallExporter)
+};
+
+template <class T>
+bool WaterfallExporter::snapshot(const WaterfallData<T>& data, const QRectF& window, WaterfallSnapshot& snapshot)
+{
+    snapshot = WaterfallSnapshot();
+
+    const size_t all = std::numeric_limits<size_t>::max();
+    const typename WaterfallData<T>::View view = data.view(0, all, 0, all);
+    if (!view.isValid())
+    {
+        return true;
+    }
+
+    // filled rows are the last ones of the history
+    size_t rowBegin = view.rows() - view.filledRows();
+    size_t rowEnd = view.rows();
+    size_t colBegin = 0;
+    size_t colEnd = view.cols();
+
+    // the bins are read with the data pinned (they may be changed by another thread)
+    const bool current = view.read(0, 0, [&](const size_t)
+    {
+        if (window.isValid())
+        {
+            const double yBegin = std::floor(window.top() - view.offset());
+            const double yEnd = std::ceil(window.top() + window.height() - view.offset());
+            rowBegin = std::max(rowBegin, size_t(std::max(yBegin, 0.)));
+            rowEnd = std::min(rowEnd, size_t(std::max(yEnd, 0.)));
+
+            colBegin = data.getColumn(window.left());
+            colEnd = data.getColumn(window.left() + window.width()) + 1;
+        }
+
+        snapshot.xValues.resize(colEnd - std::min(colBegin, colEnd));
+        for (size_t col = colBegin; col < colEnd; ++col)
+        {
+            snapshot.xValues[col - colBegin] = data.getBinCenter(col);
+        }
+    });
+    if (!current || rowBegin >= rowEnd || colBegin >= colEnd)
+    {
+        snapshot = WaterfallSnapshot();
+        return current;
+    }
+
+    snapshot.rows = rowEnd - rowBegin;
+    snapshot.cols = colEnd - colBegin;
+    snapshot.values.resize(snapshot.rows * snapshot.cols);
+    snapshot.timestamps.resize(snapshot.rows);
+
+    /* copied by chunks, the data being pinned for each one only, newest rows first:
+     * the layers added meanwhile overwrite the oldest rows, which are dropped */
+    const size_t chunkRows = std::max(size_t(1 << 20) / (snapshot.cols * sizeof(T)), size_t(1));
+    size_t firstValid = rowBegin;
+    for (size_t end = rowEnd; end > firstValid; )
+    {
+        const size_t begin = (end - firstValid > chunkRows) ? end - chunkRows : firstValid;
+        const bool pinned = view.read(begin, end, [&](const size_t first)
+        {
+            if (first > begin)
+            {
+                firstValid = first; // the older rows were overwritten
+            }
+            for (size_t row = first; row < end; ++row)
+            {
+                const T* const layer = view.row(row) + colBegin;
+                std::copy(layer, layer + snapshot.cols, snapshot.values.begin() + (row - rowBegin) * snapshot.cols);
+                snapshot.timestamps[row - rowBegin] = qint64(view.timestamp(row));
+            }
+        });
+        if (!pinned)
+        {
+            snapshot = WaterfallSnapshot(); // resized or cleared meanwhile
+            return false;
+        }
+        end = begin;
+    }
+
+    if (firstValid > rowBegin)
+    {
+        const size_t dropped = firstValid - rowBegin;
+        snapshot.values.erase(snapshot.values.begin(), snapshot.values.begin() + dropped * snapshot.cols);
+        snapshot.timestamps.erase(snapshot.timestamps.begin(), snapshot.timestamps.begin() + dropped);
+        snapshot.rows -= dropped;
+    }
+
+    return true;
+}
+
+#endif // WATERFALLEXPORTER_H
@@ -0,0 +1,336 @@
+#ifndef WATERFALLFRAMEPARSER_H
+#define WATERFALLFRAMEPARSER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+/* Incremental parser of framed layers received from a byte stream (serial
+ * port, socket, pipe...). Bytes can be fed in chunks of any size, samples are
+ * decoded directly into preallocated layer slots (no frame buffer, no
+ * allocation per frame) and completed layers are kept until the batch is
+ * consumed with clearBatch().
+ *
+ * Frame (little endian):
+ *   uint32 magic ("WFL1"), uint32 points, int64 timestamp (time_t),
+ *   uint8 sample type (see SampleType), 3 reserved bytes,
+ *   points samples.
+ * After garbage or a bad header, the parser resynchronizes on the next magic.
+ */
+class WaterfallFrameParser
+{
+public:
+    enum SampleType
+    {
+        Float32 = 0,
+        Float64 = 1,
+        Int16   = 2,
+        UInt8   = 3
+    };
+
+    static const uint32_t s_magic = 0x314C4657u; // "WFL1"
+    static const size_t   s_headerSize = 20;
+
+    // frames with more points are rejected
+    explicit WaterfallFrameParser(const size_t maxPoints = 65536, const size_t batchSize = 64) :
+        m_maxPoints(std::max(maxPoints, size_t(1))),
+        m_batchSize(std::max(batchSize, size_t(1)))
+    {
+        m_points.resize(m_batchSize);
+        m_timestamps.resize(m_batchSize);
+    }
+
+    /* Slots are allocated for layers of up to points values, a larger frame
+     * (up to maxPoints) reallocates them once. */
+    void reserve(const size_t points)
+    {
+        if (points > m_slotSize)
+        {
+            // the completed layers of the batch are kept
+            const size_t slotSize = std::min(points, m_maxPoints);
+            std::vector<double> slots(slotSize * m_batchSize, 0.);
+            for (size_t i = 0; i < m_count; ++i)
+            {
+                std::copy(layer(i), layer(i) + m_points[i], slots.begin() + i * slotSize);
+            }
+            m_slots.swap(slots);
+            m_slotSize = slotSize;
+        }
+    }
+
+    /* Consumes bytes until they're exhausted or the batch is full,
+     * returns the number of consumed bytes. */
+    size_t feed(const char* const data, const size_t length)
+    {
+        size_t pos = 0;
+        while (pos < length && m_count < m_batchSize)
+        {
+            if (m_state == Header)
+            {
+                // the magic is checked before reading the rest of the header
+                const size_t wanted = (m_headerFill < 4) ? 4 : s_headerSize;
+                const size_t n = std::min(wanted - m_headerFill, length - pos);
+                std::memcpy(m_header + m_headerFill, data + pos, n);
+                m_headerFill += n;
+                pos += n;
+
+                if (m_headerFill == 4 && readU32(m_header) != s_magic)
+                {
+                    // resync: drop the first byte of the candidate magic
+                    std::memmove(m_header, m_header + 1, 3);
+                    m_headerFill = 3;
+                    ++m_skippedBytes;
+                    continue;
+                }
+                if (m_headerFill == s_headerSize)
+                {
+                    startPayload();
+                }
+                continue;
+            }
+
+            // payload: samples are decoded straight into the slot
+            const size_t sampleSize = m_sampleSize;
+            double* const slot = m_slots.data() + m_count * m_slotSize;
+            if (m_sampleFill > 0 || length - pos < sampleSize)
+            {
+                // sample split between two chunks
+                const size_t n = std::min(sampleSize - m_sampleFill, length - pos);
+                std::memcpy(m_sample + m_sampleFill, data + pos, n);
+                m_sampleFill += n;
+                pos += n;
+                if (m_sampleFill == sampleSize)
+                {
+                    slot[m_decoded++] = decode(m_sample);
+                    m_sampleFill = 0;
+                }
+            }
+            else
+            {
+                const size_t samples = std::min(m_framePoints - m_decoded, (length - pos) / sampleSize);
+                decode(data + pos, samples, slot + m_decoded);
+                m_decoded += samples;
+                pos += samples * sampleSize;
+            }
+
+            if (m_decoded == m_framePoints)
+            {
+                m_points[m_count] = m_framePoints;
+                m_timestamps[m_count] = m_frameTimestamp;
+                ++m_count;
+                ++m_frames;
+                m_state = Header;
+                m_headerFill = 0;
+            }
+        }
+        return pos;
+    }
+
+    bool isBatchFull() const { return m_count == m_batchSize; }
+    size_t count() const { return m_count; }
+    const double* layer(const size_t i) const { return m_slots.data() + i * m_slotSize; }
+    size_t points(const size_t i) const { return m_points[i]; }
+    time_t timestamp(const size_t i) const { return m_timestamps[i]; }
+    void clearBatch() { m_count = 0; }
+
+    // drops a partially received frame (e.g. after a reconnection)
+    void reset()
+    {
+        m_state = Header;
+        m_headerFill = 0;
+        m_sampleFill = 0;
+        m_count = 0;
+    }
+
+    uint64_t frames() const { return m_frames; }
+    uint64_t rejectedFrames() const { return m_rejectedFrames; }
+    uint64_t skippedBytes() const { return m_skippedBytes; }
+
+    // serializes a frame (senders, tests)
+    template <class T>
+    static std::vector<char> encode(const T* const values, const size_t points,
+                                    const time_t timestamp, const SampleType type)
+    {
+        std::vector<char> frame(s_headerSize + points * sampleSize(type));
+        writeU32(frame.data(), s_magic);
+        writeU32(frame.data() + 4, uint32_t(points));
+        const int64_t ts = int64_t(timestamp);
+        for (int i = 0; i < 8; ++i)
+        {
+            frame[8 + i] = char((uint64_t(ts) >> (8 * i)) & 0xff);
+        }
+        frame[16] = char(type);
+
+        char* out = frame.data() + s_headerSize;
+        for (size_t i = 0; i < points; ++i, out += sampleSize(type))
+        {
+            switch (type)
+            {
+            case Float32: { const float v = float(values[i]); std::memcpy(out, &v, 4); break; }
+            case Float64: { const double v = double(values[i]); std::memcpy(out, &v, 8); break; }
+            case Int16:   { const int16_t v = int16_t(values[i]); std::memcpy(out, &v, 2); break; }
+            case UInt8:   { *out = char(uint8_t(values[i])); break; }
+            }
+        }
+        return frame;
+    }
+
+    static size_t sampleSize(const int type)
+    {
+        switch (type)
+        {
+        case Float32: return 4;
+        case Float64: return 8;
+        case Int16:   return 2;
+        case UInt8:   return 1;
+        default:      return 0;
+        }
+    }
+
+protected:
+    enum State
+    {
+        Header,
+        Payload
+    };
+
+    static uint32_t readU32(const unsigned char* const p)
+    {
+        return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    static void writeU32(char* const p, const uint32_t v)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            p[i] = char((v >> (8 * i)) & 0xff);
+        }
+    }
+
+    void startPayload()
+    {
+        const uint32_t points = readU32(m_header + 4);
+        uint64_t ts = 0;
+        for (int i = 7; i >= 0; --i)
+        {
+            ts = (ts << 8) | m_header[8 + i];
+        }
+        m_sampleType = m_header[16];
+        m_sampleSize = sampleSize(m_sampleType);
+
+        if (points == 0 || points > m_maxPoints || m_sampleSize == 0)
+        {
+            // bad header: look for the next magic after this one
+            ++m_rejectedFrames;
+            std::memmove(m_header, m_header + 1, s_headerSize - 1);
+            m_headerFill = s_headerSize - 1;
+            rescan();
+            return;
+        }
+
+        reserve(points);
+        m_framePoints = points;
+        m_frameTimestamp = time_t(int64_t(ts));
+        m_decoded = 0;
+        m_sampleFill = 0;
+        m_state = Payload;
+    }
+
+    // keeps the bytes of m_header from the first possible magic
+    void rescan()
+    {
+        size_t i = 0;
+        for (; i + 4 <= m_headerFill; ++i)
+        {
+            if (readU32(m_header + i) == s_magic)
+            {
+                break;
+            }
+        }
+        if (i + 4 > m_headerFill)
+        {
+            i = (m_headerFill > 3) ? m_headerFill - 3 : 0;
+        }
+        m_skippedBytes += i + 1; // + the first byte dropped by the caller
+        std::memmove(m_header, m_header + i, m_headerFill - i);
+        m_headerFill -= i;
+    }
+
+    double decode(const unsigned char* const p) const
+    {
+        return decodeOne(reinterpret_cast<const char*>(p));
+    }
+
+    double decodeOne(const char* const p) const
+    {
+        switch (m_sampleType)
+        {
+        case Float32: { float v; std::memcpy(&v, p, 4); return double(v); }
+        case Float64: { double v; std::memcpy(&v, p, 8); return v; }
+        case Int16:   { int16_t v; std::memcpy(&v, p, 2); return double(v); }
+        default:      return double(uint8_t(*p));
+        }
+    }
+
+    // tight loops per type so they can be vectorized
+    void decode(const char* const in, const size_t samples, double* const out) const
+    {
+        switch (m_sampleType)
+        {
+        case Float32:
+            for (size_t i = 0; i < samples; ++i)
+            {
+                float v;
+                std::memcpy(&v, in + 4 * i, 4);
+                out[i] = double(v);
+            }
+            break;
+        case Float64:
+            std::memcpy(out, in, samples * 8);
+            break;
+        case Int16:
+            for (size_t i = 0; i < samples; ++i)
+            {
+                int16_t v;
+                std::memcpy(&v, in + 2 * i, 2);
+                out[i] = double(v);
+            }
+            break;
+        default:
+            for (size_t i = 0; i < samples; ++i)
+            {
+                out[i] = double(uint8_t(in[i]));
+            }
+            break;
+        }
+    }
+
+    const size_t m_maxPoints;
+    const size_t m_batchSize;
+
+    // m_batchSize slots of m_slotSize values
+    std::vector<double> m_slots;
+    size_t              m_slotSize = 0;
+    std::vector<size_t> m_points;
+    std::vector<time_t> m_timestamps;
+    size_t              m_count = 0;
+
+    State         m_state = Header;
+    unsigned char m_header[s_headerSize];
+    size_t        m_headerFill = 0;
+    unsigned char m_sample[8];
+    size_t        m_sampleFill = 0;
+    int           m_sampleType = Float32;
+    size_t        m_sampleSize = 4;
+    size_t        m_framePoints = 0;
+    size_t        m_decoded = 0;
+    time_t        m_frameTimestamp = 0;
+
+    uint64_t m_frames = 0;
+    uint64_t m_rejectedFrames = 0;
+    uint64_t m_skippedBytes = 0;
+};
+
+#endif // WATERFALLFRAMEPARSER_H
@@ -0,0 +1,247 @@
+#include "WaterfallGrid.h"
+
+#include <QDateTime>
+#include <QFontMetrics>
+#include <QPaintEvent>
+#include <QPainter>
+
+#include <qwt_scale_div.h>
+#include <qwt_scale_engine.h>
+
+#include <cmath>
+
+#include "WaterfallTilePool.h"
+
+WaterfallGrid::WaterfallGrid(QWidget* parent /*= nullptr*/,
+                             const ColorMaps::ControlPoints& ctrlPts /*= ColorMaps::Jet()*/) :
+    QWidget(parent),
+    m_renderer(ctrlPts)
+{
+    // the cells are rendered in parallel, a cell per job
+    m_renderer.setThreadCount(1);
+    m_renderer.setBackground(qRgb(0, 0, 0));
+}
+
+void WaterfallGrid::setChannels(const WaterfallChannels<double>* const channels)
+{
+    m_channels = channels;
+    m_visible.assign((m_channels) ? m_channels->channelCount() : 0, true);
+    updateLayout();
+    update();
+}
+
+void WaterfallGrid::setColumns(const int columns)
+{
+    m_columns = std::max(columns, 0);
+    updateLayout();
+    update();
+}
+
+void WaterfallGrid::setChannelVisible(const size_t channel, const bool visible)
+{
+    if (channel < m_visible.size() && m_visible[channel] != visible)
+    {
+        m_visible[channel] = visible;
+        updateLayout();
+        update();
+    }
+}
+
+bool WaterfallGrid::isChannelVisible(const size_t channel) const
+{
+    return channel < m_visible.size() && m_visible[channel];
+}
+
+void WaterfallGrid::setRange(double dLower, double dUpper)
+{
+    m_renderer.setRange(dLower, dUpper);
+    update();
+}
+
+bool WaterfallGrid::setColorMap(const ColorMaps::ControlPoints& colorMap)
+{
+    if (!m_renderer.setColorMap(colorMap))
+    {
+        return false;
+    }
+    update();
+    return true;
+}
+
+void WaterfallGrid::setColorMap(const ColorMaps::ColorMap& colorMap)
+{
+    m_renderer.setColorMap(colorMap);
+    update();
+}
+
+QSize WaterfallGrid::sizeHint() const
+{
+    return QSize(800, 600);
+}
+
+void WaterfallGrid::resizeEvent(QResizeEvent* event)
+{
+    QWidget::resizeEvent(event);
+    updateLayout();
+}
+
+void WaterfallGrid::updateLayout()
+{
+    m_layout = Layout();
+
+    if (!m_channels)
+    {
+        return;
+    }
+    for (size_t i = 0; i < m_visible.size(); ++i)
+    {
+        if (m_visible[i])
+        {
+            m_layout.channels.push_back(i);
+        }
+    }
+    const int count = int(m_layout.channels.size());
+    if (count == 0)
+    {
+        return;
+    }
+
+    const int columns = (m_columns > 0) ? std::min(m_columns, count)
+                                        : int(std::ceil(std::sqrt(double(count))));
+    const int rows = (count + columns - 1) / columns;
+    m_layout.columns = columns;
+
+    const QFontMetrics metrics(font());
+    const int spacing = 4;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+    const int timeAxisWidth = metrics.horizontalAdvance("00:00:00") + 8;
+#else
+    const int timeAxisWidth = metrics.width("00:00:00") + 8;
+#endif
+    const int xAxisHeight = metrics.height() + 6;
+    m_layout.titleHeight = metrics.height() + 2;
+
+    const QRect area = rect().adjusted(timeAxisWidth, 0, 0, -xAxisHeight);
+    const int cellWidth = (area.width() - (columns - 1) * spacing) / columns;
+    const int cellHeight = (area.height() - (rows - 1) * spacing) / rows;
+    const int canvasHeight = cellHeight - m_layout.titleHeight;
+    if (cellWidth <= 0 || canvasHeight <= 0)
+    {
+        m_layout.channels.clear();
+        return;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        const int row = i / columns;
+        const int col = i % columns;
+        m_layout.canvases.push_back(QRect(area.left() + col * (cellWidth + spacing),
+                                          area.top() + row * (cellHeight + spacing) + m_layout.titleHeight,
+                                          cellWidth, canvasHeight));
+    }
+    m_layout.xAxis = QRect(area.left(), area.bottom() + 1, area.width(), xAxisHeight);
+    m_layout.timeAxis = QRect(0, area.top(), timeAxisWidth, area.height());
+
+    // the channels share their X bounds: the ticks are the same for every canvas
+    const WaterfallData<double>& data = m_channels->channel(0);
+    const double xMin = data.getXMin();
+    const double xMax = data.getXMax();
+    if (xMax > xMin)
+    {
+        QwtLinearScaleEngine engine;
+        const QwtScaleDiv div = engine.divideScale(xMin, xMax, std::max(2, cellWidth / 80), 0);
+        for (const double tick : div.ticks(QwtScaleDiv::MajorTick))
+        {
+            const int x = int((tick - xMin) / (xMax - xMin) * cellWidth);
+            m_layout.xTicks.push_back(std::make_pair(x, QString::number(tick)));
+        }
+    }
+}
+
+void WaterfallGrid::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(this);
+    painter.fillRect(event->rect(), palette().window());
+
+    const size_t count = m_layout.canvases.size();
+    if (!m_channels || count == 0)
+    {
+        return;
+    }
+
+    // 1. render the exposed canvases
+    m_images.resize(count);
+    std::vector<size_t> exposed;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (event->rect().intersects(m_layout.canvases[i].adjusted(0, -m_layout.titleHeight, 0, 0)))
+        {
+            exposed.push_back(i);
+            if (m_images[i].size() != m_layout.canvases[i].size())
+            {
+                m_images[i] = QImage(m_layout.canvases[i].size(), QImage::Format_ARGB32);
+            }
+        }
+    }
+
+    // the persistent pool's threads: no thread created per paint
+    WaterfallTilePool::instance().run(exposed.size(), [&](const size_t e)
+    {
+        const size_t i = exposed[e];
+        const WaterfallData<double>& data = m_channels->channel(m_layout.channels[i]);
+        QImage& image = m_images[i];
+        const QRectF window(data.getXMin(), data.getOffset(),
+                            data.getXMax() - data.getXMin(), data.getMaxHistoryLength());
+        // bits() was detached when the image was (re)allocated: no detach from the threads
+        m_renderer.render(data, window, reinterpret_cast<QRgb*>(image.bits()),
+                          image.width(), image.height(), image.bytesPerLine() / sizeof(QRgb));
+    });
+
+    // 2. cells
+    painter.setPen(palette().windowText().color());
+    for (const size_t i : exposed)
+    {
+        const QRect& canvas = m_layout.canvases[i];
+        painter.drawImage(canvas.topLeft(), m_images[i]);
+        painter.drawText(QRect(canvas.left(), canvas.top() - m_layout.titleHeight, canvas.width(), m_layout.titleHeight),
+                         Qt::AlignLeft | Qt::AlignVCenter, QString("Ch %1").arg(m_layout.channels[i] + 1));
+    }
+
+    // 3. shared axes: X ticks under each column, newest/oldest times left of each row
+    if (event->rect().intersects(m_layout.xAxis))
+    {
+        for (int col = 0; col < std::min(m_layout.columns, int(count)); ++col)
+        {
+            const QRect& canvas = m_layout.canvases[col];
+            for (const auto& tick : m_layout.xTicks)
+            {
+                const int x = canvas.left() + tick.first;
+                painter.drawLine(x, m_layout.xAxis.top(), x, m_layout.xAxis.top() + 3);
+                painter.drawText(QRect(x - 40, m_layout.xAxis.top() + 3, 80, m_layout.xAxis.height() - 3),
+                                 Qt::AlignHCenter | Qt::AlignTop, tick.second);
+            }
+        }
+    }
+    if (event->rect().intersects(m_layout.timeAxis))
+    {
+        const WaterfallData<double>& data = m_channels->channel(m_layout.channels.front());
+        const size_t maxHistory = data.getMaxHistoryLength();
+        const time_t newest = data.getLayerDate(double(maxHistory - 1));
+        const time_t oldest = data.getLayerDate(double(maxHistory - data.getHistoryLength()));
+        for (size_t i = 0; i < count; i += size_t(m_layout.columns))
+        {
+            const QRect& canvas = m_layout.canvases[i];
+            const QRect label(m_layout.timeAxis.left(), canvas.top(), m_layout.timeAxis.width() - 4, canvas.height());
+            if (newest > 0)
+            {
+                painter.drawText(label, Qt::AlignRight | Qt::AlignTop,
+                                 QDateTime::fromTime_t(uint(newest)).toString("hh:mm:ss"));
+            }
+            if (oldest > 0 && data.getHistoryLength() == maxHistory)
+            {
+                painter.drawText(label, Qt::AlignRight | Qt::AlignBottom,
+                                 QDateTime::fromTime_t(uint(oldest)).toString("hh:mm:ss"));
+            }
+        }
+    }
+}
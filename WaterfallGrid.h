@@ -0,0 +1,73 @@
+#ifndef WATERFALLGRID_H
+#define WATERFALLGRID_H
+
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <QWidget>
+
+#include <utility>
+#include <vector>
+
+#include "ColorMaps.h"
+#include "WaterfallChannels.h"
+#include "WaterfallRenderer.h"
+
+/* Grid of the waterfalls of a WaterfallChannels in a single widget: one
+ * paint for all the channels instead of a Waterfallplot (plots, timers,
+ * layouts and replots) per channel.
+ * All the canvases have the same size, so the layout and the axes (X ticks
+ * below the grid, time labels on its left) are computed once for every
+ * channel. Only the shown channels whose cell is exposed (e.g. in a
+ * QScrollArea) are rendered, in parallel (a cell per job of the shared
+ * WaterfallTilePool) through a single WaterfallRenderer.
+ */
+class WaterfallGrid : public QWidget
+{
+public:
+    explicit WaterfallGrid(QWidget* parent = nullptr, const ColorMaps::ControlPoints& ctrlPts = ColorMaps::Jet());
+
+    // not owned, must outlive the grid (nullptr: empty grid)
+    void setChannels(const WaterfallChannels<double>* const channels);
+    const WaterfallChannels<double>* channels() const { return m_channels; }
+
+    void setColumns(const int columns); // 0: about square grid (default)
+    void setChannelVisible(const size_t channel, const bool visible);
+    bool isChannelVisible(const size_t channel) const;
+
+    void setRange(double dLower, double dUpper);
+    bool setColorMap(const ColorMaps::ControlPoints& colorMap);
+    void setColorMap(const ColorMaps::ColorMap& colorMap);
+
+    // to be called after addFrame(): the exposed cells are repainted (coalesced by Qt)
+    void replot() { update(); }
+
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+
+    void updateLayout();
+
+    // shared by all the cells, rebuilt on resize or when the shown channels change
+    struct Layout
+    {
+        std::vector<QRect>  canvases;   // one per shown channel
+        std::vector<size_t> channels;   // channel of each canvas
+        int                 columns = 0;
+        int                 titleHeight = 0;
+        QRect               xAxis;      // below the grid
+        QRect               timeAxis;   // left of the grid
+        std::vector<std::pair<int, QString>> xTicks; // offset in a canvas, label
+    };
+
+    const WaterfallChannels<double>* m_channels = nullptr;
+    std::vector<bool>   m_visible;
+    int                 m_columns = 0;
+    WaterfallRenderer   m_renderer;
+    Layout              m_layout;
+    std::vector<QImage> m_images; // one per canvas, reused between paints
+};
+
+#endif // WATERFALLGRID_H
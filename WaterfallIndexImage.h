@@ -0,0 +1,192 @@
+#ifndef WATERFALLINDEXIMAGE_H
+#define WATERFALLINDEXIMAGE_H
+
+#include <QImage>
+#include <QRect>
+#include <QRgb>
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "WaterfallTilePool.h"
+
+/* Rasterized values kept as 16 bits indices normalized to the range of the
+ * rendered values (instead of final colors): a range (contrast) or a color map
+ * change is then a per pixel lookup remap of the cached indices, the data isn't
+ * rasterized again. The resolution is (values max - values min) / 65534, NaN
+ * have their own index (drawn with the color of NaN).
+ * The image is processed in square tiles (row-major inside a tile) scheduled
+ * on the shared WaterfallTilePool.
+ */
+class WaterfallIndexImage
+{
+public:
+    static const quint16 s_nanIndex = 0xffff;
+    static const size_t  s_maxIndex = 0xfffe;
+    static const size_t  s_colorSamples = 4096; // color map sampling of a remap
+
+    // side of the tiles in pixels (default: 64)
+    void setTileSize(const int size) { m_tileSize = std::max(size, 1); }
+    int getTileSize() const { return m_tileSize; }
+
+    /* valueAt(x, y): value of the pixel (called from several threads),
+     * tiles are rasterized in parallel (threadCount 0: hardware concurrency) */
+    template <class ValueAt>
+    void rasterize(const int width, const int height, ValueAt valueAt, const size_t threadCount = 0)
+    {
+        m_width = std::max(width, 0);
+        m_height = std::max(height, 0);
+        const size_t pixels = size_t(m_width) * m_height;
+        m_values.resize(pixels);
+        m_indices.resize(pixels);
+        if (pixels == 0)
+        {
+            return;
+        }
+
+        // 1. values and their range, per tile
+        struct Range
+        {
+            double min = qInf();
+            double max = -qInf();
+        };
+        std::vector<Range> ranges(tileCount());
+        forEachTile([&](const size_t tile, const QRect& rect)
+        {
+            Range& range = ranges[tile];
+            for (int y = rect.top(); y <= rect.bottom(); ++y)
+            {
+                double* const out = m_values.data() + size_t(y) * m_width;
+                for (int x = rect.left(); x <= rect.right(); ++x)
+                {
+                    const double value = valueAt(x, y);
+                    out[x] = value;
+                    if (!std::isnan(value))
+                    {
+                        range.min = std::min(range.min, value);
+                        range.max = std::max(range.max, value);
+                    }
+                }
+            }
+        }, threadCount);
+
+        Range range;
+        for (const Range& tile : ranges)
+        {
+            range.min = std::min(range.min, tile.min);
+            range.max = std::max(range.max, tile.max);
+        }
+        m_min = (range.min <= range.max) ? range.min : 0.;
+        m_step = (range.max > range.min) ? (range.max - range.min) / s_maxIndex : 0.;
+
+        // 2. quantization
+        const double scale = (m_step > 0.) ? 1. / m_step : 0.;
+        forEachTile([&](const size_t, const QRect& rect)
+        {
+            for (int y = rect.top(); y <= rect.bottom(); ++y)
+            {
+                const size_t row = size_t(y) * m_width;
+                for (int x = rect.left(); x <= rect.right(); ++x)
+                {
+                    const double value = m_values[row + x];
+                    m_indices[row + x] = (std::isnan(value)) ? s_nanIndex
+                                         : quint16(std::min((value - m_min) * scale + 0.5, double(s_maxIndex)));
+                }
+            }
+        }, threadCount);
+
+        // the values are only needed while rasterizing (the buffer is reused)
+        m_values.clear();
+    }
+
+    /* Image of the indices for a range, colorAt(value) is the color of a value
+     * (NaN included) for this range, e.g. QwtColorMap::rgb(range, value). */
+    template <class ColorAt>
+    QImage remap(const double zMin, const double zMax, ColorAt colorAt, const size_t threadCount = 0) const
+    {
+        QImage image(m_width, m_height, QImage::Format_ARGB32);
+        if (isNull())
+        {
+            return image;
+        }
+
+        // color map sampled over the range, then a color for each index
+        QRgb samples[s_colorSamples];
+        const double width = zMax - zMin;
+        for (size_t i = 0; i < s_colorSamples; ++i)
+        {
+            samples[i] = colorAt(zMin + width * i / (s_colorSamples - 1));
+        }
+        m_table.resize(s_nanIndex + 1);
+        const double scale = (width > 0.) ? (s_colorSamples - 1) / width : 0.;
+        const double last = double(s_colorSamples - 1);
+        for (size_t index = 0; index <= s_maxIndex; ++index)
+        {
+            double sample = (m_min + index * m_step - zMin) * scale;
+            sample = (sample > 0.) ? sample : 0.;
+            sample = (sample < last) ? sample : last;
+            m_table[index] = samples[size_t(sample)];
+        }
+        m_table[s_nanIndex] = colorAt(qQNaN());
+
+        QRgb* const bits = reinterpret_cast<QRgb*>(image.bits());
+        const size_t stride = image.bytesPerLine() / sizeof(QRgb);
+        forEachTile([&](const size_t, const QRect& rect)
+        {
+            for (int y = rect.top(); y <= rect.bottom(); ++y)
+            {
+                const quint16* const in = m_indices.data() + size_t(y) * m_width;
+                QRgb* const out = bits + size_t(y) * stride;
+                for (int x = rect.left(); x <= rect.right(); ++x)
+                {
+                    out[x] = m_table[in[x]];
+                }
+            }
+        }, threadCount);
+        return image;
+    }
+
+    bool isNull() const { return m_width == 0 || m_height == 0; }
+
+    void clear()
+    {
+        m_width = m_height = 0;
+        std::vector<quint16>().swap(m_indices);
+    }
+
+    size_t getMemoryUsage() const
+    {
+        return m_indices.capacity() * sizeof(quint16) + m_values.capacity() * sizeof(double) +
+               m_table.capacity() * sizeof(QRgb);
+    }
+
+protected:
+    size_t tileColumns() const { return (size_t(m_width) + m_tileSize - 1) / m_tileSize; }
+    size_t tileCount() const { return tileColumns() * ((size_t(m_height) + m_tileSize - 1) / m_tileSize); }
+
+    // fn(tile, rect of the tile in the image)
+    template <class Fn>
+    void forEachTile(Fn fn, const size_t threadCount) const
+    {
+        const size_t columns = tileColumns();
+        WaterfallTilePool::instance().run(tileCount(), [&](const size_t tile)
+        {
+            const int left = int(tile % columns) * m_tileSize;
+            const int top = int(tile / columns) * m_tileSize;
+            fn(tile, QRect(left, top, std::min(m_tileSize, m_width - left), std::min(m_tileSize, m_height - top)));
+        }, threadCount);
+    }
+
+    int                  m_tileSize = 64;
+    int                  m_width = 0;
+    int                  m_height = 0;
+    double               m_min = 0.;   // value of index 0
+    double               m_step = 0.;  // value between two indices
+    std::vector<quint16> m_indices;    // row-major, the top row first
+    std::vector<double>  m_values;     // rasterization scratch
+    mutable std::vector<QRgb> m_table; // index -> color of the last remap
+};
+
+#endif // WATERFALLINDEXIMAGE_H
@@ -0,0 +1,138 @@
+#ifndef WATERFALLKERNELS_H
+#define WATERFALLKERNELS_H
+
+#include <cstddef>
+
+/* Element-wise kernels used on the ingest path (one layer at a time).
+ * They are written as plain loops over contiguous, non-aliasing arrays so that
+ * the compiler can vectorize them (SSE/AVX/NEON) without resorting to
+ * platform specific intrinsics.
+ */
+namespace WaterfallKernels
+{
+
+template <class A, class T>
+inline void copy(A* __restrict acc, const T* __restrict in, const size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        acc[i] = A(in[i]);
+    }
+}
+
+template <class A, class T>
+inline void add(A* __restrict acc, const T* __restrict in, const size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        acc[i] += A(in[i]);
+    }
+}
+
+template <class A, class T>
+inline void subtract(A* __restrict acc, const T* __restrict in, const size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        acc[i] -= A(in[i]);
+    }
+}
+
+template <class A, class T>
+inline void max(A* __restrict acc, const T* __restrict in, const size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        const A v = A(in[i]);
+        acc[i] = (v > acc[i]) ? v : acc[i];
+    }
+}
+
+template <class A, class T>
+inline void min(A* __restrict acc, const T* __restrict in, const size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        const A v = A(in[i]);
+        acc[i] = (v < acc[i]) ? v : acc[i];
+    }
+}
+
+// exponential moving average: acc += alpha * (in - acc)
+template <class A, class T>
+inline void exponential(A* __restrict acc, const T* __restrict in, const size_t n, const A alpha)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        acc[i] += alpha * (A(in[i]) - acc[i]);
+    }
+}
+
+// out = acc * factor (converted to the output type)
+template <class T, class A>
+inline void scale(T* __restrict out, const A* __restrict acc, const size_t n, const A factor)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        out[i] = T(acc[i] * factor);
+    }
+}
+
+/* Resampling of a layer of inLen points to outLen points covering the same span.
+ * Decimation (inLen > outLen): each input point belongs to a single output bin,
+ * whose value is the max (peaks are preserved) or the mean of its points. */
+template <class T>
+inline void decimateMax(T* __restrict out, const size_t outLen, const T* __restrict in, const size_t inLen)
+{
+    for (size_t i = 0; i < outLen; ++i)
+    {
+        const size_t begin = i * inLen / outLen;
+        const size_t end = (i + 1) * inLen / outLen;
+        T m = in[begin];
+        for (size_t j = begin + 1; j < end; ++j)
+        {
+            m = (in[j] > m) ? in[j] : m;
+        }
+        out[i] = m;
+    }
+}
+
+template <class T>
+inline void decimateMean(T* __restrict out, const size_t outLen, const T* __restrict in, const size_t inLen)
+{
+    for (size_t i = 0; i < outLen; ++i)
+    {
+        const size_t begin = i * inLen / outLen;
+        const size_t end = (i + 1) * inLen / outLen;
+        double sum = 0.;
+        for (size_t j = begin; j < end; ++j)
+        {
+            sum += double(in[j]);
+        }
+        out[i] = T(sum / (end - begin));
+    }
+}
+
+// upsampling (inLen < outLen): linear interpolation between the bins centers
+template <class T>
+inline void interpolateLinear(T* __restrict out, const size_t outLen, const T* __restrict in, const size_t inLen)
+{
+    const double ratio = double(inLen) / outLen;
+    for (size_t i = 0; i < outLen; ++i)
+    {
+        double pos = (i + 0.5) * ratio - 0.5;
+        pos = (pos > 0.) ? pos : 0.;
+        size_t j = size_t(pos);
+        if (j + 1 >= inLen)
+        {
+            out[i] = in[inLen - 1];
+            continue;
+        }
+        const double t = pos - j;
+        out[i] = T(double(in[j]) + t * (double(in[j + 1]) - double(in[j])));
+    }
+}
+
+}
+
+#endif // WATERFALLKERNELS_H
@@ -0,0 +1,56 @@
+#ifndef WATERFALLPARALLEL_H
+#define WATERFALLPARALLEL_H
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace WaterfallParallel
+{
+
+inline size_t threadCount()
+{
+    const unsigned count = std::thread::hardware_concurrency();
+    return (count > 0) ? count : 1;
+}
+
+/* Calls fn(begin, end) on contiguous chunks of [0, count) using up to
+ * maxThreads threads (0: threadCount()), the calling thread processes the
+ * first chunk. minChunk avoids spawning threads for small workloads. */
+template <class Fn>
+void parallelFor(const size_t count, const size_t minChunk, Fn fn, const size_t maxThreads = 0)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    const size_t available = (maxThreads > 0) ? maxThreads : threadCount();
+    const size_t threads = std::min(available, std::max(count / std::max(minChunk, size_t(1)), size_t(1)));
+    if (threads <= 1)
+    {
+        fn(size_t(0), count);
+        return;
+    }
+
+    const size_t chunk = (count + threads - 1) / threads;
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (size_t begin = chunk; begin < count; begin += chunk)
+    {
+        const size_t end = std::min(begin + chunk, count);
+        workers.emplace_back([&fn, begin, end]() { fn(begin, end); });
+    }
+
+    fn(size_t(0), std::min(chunk, count));
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+}
+
+#endif // WATERFALLPARALLEL_H
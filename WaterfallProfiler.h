@@ -0,0 +1,183 @@
+#ifndef WATERFALLPROFILER_H
+#define WATERFALLPROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/* Hot path instrumentation: durations are recorded in lock-free log-linear
+ * histograms (4 sub-buckets per power of two, so quantiles are within ~20%),
+ * they can be read from any thread while being recorded.
+ *
+ * WATERFALL_PROFILE_SCOPE() timers are compiled out unless
+ * WATERFALL_ENABLE_PROFILING is defined (CMake option of the same name).
+ */
+class WaterfallHistogram
+{
+public:
+    WaterfallHistogram() { reset(); }
+
+    void record(const uint64_t ns)
+    {
+        m_buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        for (std::atomic<uint64_t>& bucket : m_buckets)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        m_count.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+
+    // upper bound of the bucket containing the q-quantile (ns), 0 when empty
+    uint64_t quantile(const double q) const
+    {
+        uint64_t counts[s_bucketCount];
+        uint64_t total = 0;
+        for (size_t i = 0; i < s_bucketCount; ++i)
+        {
+            counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (total == 0)
+        {
+            return 0;
+        }
+
+        const uint64_t target = uint64_t(q * (total - 1)) + 1;
+        uint64_t cumulated = 0;
+        for (size_t i = 0; i < s_bucketCount; ++i)
+        {
+            cumulated += counts[i];
+            if (cumulated >= target)
+            {
+                return upperBound(i);
+            }
+        }
+        return upperBound(s_bucketCount - 1);
+    }
+
+protected:
+    static const size_t s_subBuckets = 4;
+    static const size_t s_bucketCount = 64 * s_subBuckets;
+
+    static size_t bucket(const uint64_t ns)
+    {
+        if (ns < s_subBuckets)
+        {
+            return size_t(ns);
+        }
+        size_t exponent = 63;
+        while (!(ns & (uint64_t(1) << exponent)))
+        {
+            --exponent;
+        }
+        // the two bits following the most significant one select the sub-bucket
+        const size_t sub = size_t(ns >> (exponent - 2)) & (s_subBuckets - 1);
+        return (exponent - 1) * s_subBuckets + sub;
+    }
+
+    static uint64_t upperBound(const size_t index)
+    {
+        if (index < s_subBuckets)
+        {
+            return index;
+        }
+        const size_t exponent = index / s_subBuckets + 1;
+        const uint64_t sub = index % s_subBuckets;
+        return ((s_subBuckets + sub + 1) << (exponent - 2)) - 1;
+    }
+
+    std::atomic<uint64_t> m_buckets[s_bucketCount];
+    std::atomic<uint64_t> m_count;
+};
+
+class WaterfallProfiler
+{
+public:
+    enum Stage
+    {
+        Ingest,  // Waterfallplot::addData()
+        Curves,  // Waterfallplot::updateCurvesData()
+        Layout,  // Waterfallplot::updateLayout()
+        Render,  // spectrogram rasterization
+        StageCount
+    };
+
+    static const char* stageName(const Stage stage)
+    {
+        static const char* const names[StageCount] = { "ingest", "curves", "layout", "render" };
+        return names[stage];
+    }
+
+    WaterfallHistogram& histogram(const Stage stage) { return m_histograms[stage]; }
+    const WaterfallHistogram& histogram(const Stage stage) const { return m_histograms[stage]; }
+
+    void reset()
+    {
+        for (WaterfallHistogram& histogram : m_histograms)
+        {
+            histogram.reset();
+        }
+    }
+
+private:
+    WaterfallHistogram m_histograms[StageCount];
+};
+
+// snapshot returned by Waterfallplot::stats()
+struct WaterfallStats
+{
+    struct Stage
+    {
+        uint64_t count = 0;
+        uint64_t p50Ns = 0;
+        uint64_t p99Ns = 0;
+    };
+
+    Stage    stages[WaterfallProfiler::StageCount]; // empty unless WATERFALL_ENABLE_PROFILING
+    uint64_t droppedFrames = 0;                     // frames rejected by addData()
+    double   layersPerSecond = 0.;                  // over the last second
+    size_t   memoryBytes = 0;                       // data, curves and analysis buffers
+};
+
+// records the lifetime of the object in a histogram
+class WaterfallScopedTimer
+{
+public:
+    explicit WaterfallScopedTimer(WaterfallHistogram& histogram) :
+        m_histogram(histogram),
+        m_start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~WaterfallScopedTimer()
+    {
+        const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - m_start;
+        m_histogram.record(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+private:
+    WaterfallScopedTimer(const WaterfallScopedTimer&) = delete;
+    WaterfallScopedTimer& operator=(const WaterfallScopedTimer&) = delete;
+
+    WaterfallHistogram&                   m_histogram;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#ifdef WATERFALL_ENABLE_PROFILING
+#define WATERFALL_PROFILE_CONCAT_(a, b) a##b
+#define WATERFALL_PROFILE_CONCAT(a, b) WATERFALL_PROFILE_CONCAT_(a, b)
+#define WATERFALL_PROFILE_SCOPE(profiler, stage) \
+    WaterfallScopedTimer WATERFALL_PROFILE_CONCAT(waterfallScopedTimer, __LINE__)((profiler).histogram(stage))
+#else
+#define WATERFALL_PROFILE_SCOPE(profiler, stage) do {} while (false)
+#endif
+
+#endif // WATERFALLPROFILER_H
@@ -0,0 +1,54 @@
+#include "WaterfallRenderer.h"
+
+#include <algorithm>
+
+WaterfallRenderer::WaterfallRenderer(const ColorMaps::ControlPoints& ctrlPts /*= ColorMaps::Jet()*/)
+{
+    if (!setColorMap(ctrlPts))
+    {
+        setColorMap(ColorMaps::Jet());
+    }
+}
+
+bool WaterfallRenderer::setColorMap(const ColorMaps::ControlPoints& ctrlPts)
+{
+    // same requirements and colors as the color maps of Waterfallplot
+    if (!ColorMaps::makeLut(ctrlPts, m_lut))
+    {
+        return false;
+    }
+
+    m_preset = nullptr;
+    m_ctrlPts = ctrlPts;
+    return true;
+}
+
+void WaterfallRenderer::setColorMap(const ColorMaps::ColorMap& colorMap)
+{
+    m_preset = &colorMap;
+}
+
+ColorMaps::ControlPoints WaterfallRenderer::getColorMap() const
+{
+    return (m_preset) ? ColorMaps::toControlPoints(*m_preset) : m_ctrlPts;
+}
+
+void WaterfallRenderer::setRange(double dLower, double dUpper)
+{
+    if (dLower > dUpper)
+    {
+        std::swap(dLower, dUpper);
+    }
+    m_rangeMin = dLower;
+    m_rangeMax = dUpper;
+
+    const double width = m_rangeMax - m_rangeMin;
+    m_lutScale = (width > 0.) ? (s_lutSize - 1) / width : 0.;
+}
+
+void WaterfallRenderer::getRange(double& rangeMin, double& rangeMax) const
+{
+    rangeMin = m_rangeMin;
+    rangeMax = m_rangeMax;
+}
+
@@ -0,0 +1,200 @@
+#ifndef WATERFALLRENDERER_H
+#define WATERFALLRENDERER_H
+
+#include <QImage>
+#include <QRectF>
+#include <QSize>
+#include <QRgb>
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+#include "ColorMaps.h"
+#include "WaterfallParallel.h"
+
+/* GUI-free rasterization of waterfall data: no widget nor QApplication is
+ * needed (only QtGui for QImage), so it can be used on a headless server
+ * (e.g. with QT_QPA_PLATFORM=offscreen) to generate waterfall images.
+ *
+ * Colors are interpolated linearly between the control points (like
+ * QwtLinearColorMap in RGB mode) through a lookup table, values outside of the
+ * range are clamped and NaN are drawn with the background color.
+ * Rows of the image are rendered in parallel (tiles of rows).
+ * The top of the image shows the newest layers, like Waterfallplot.
+ */
+class WaterfallRenderer
+{
+public:
+    explicit WaterfallRenderer(const ColorMaps::ControlPoints& ctrlPts = ColorMaps::Jet());
+
+    bool setColorMap(const ColorMaps::ControlPoints& ctrlPts);
+    // baked color map (e.g. a preset, must outlive the renderer): its lookup table is used as is
+    void setColorMap(const ColorMaps::ColorMap& colorMap);
+    ColorMaps::ControlPoints getColorMap() const;
+
+    void setRange(double dLower, double dUpper);
+    void getRange(double& rangeMin, double& rangeMax) const;
+
+    void setBackground(const QRgb background) { m_background = background; }
+    QRgb getBackground() const { return m_background; }
+
+    // 0: hardware concurrency
+    void setThreadCount(const size_t count) { m_threadCount = count; }
+    size_t getThreadCount() const { return m_threadCount; }
+
+    /* Renders a window of a WaterfallData (or any class with the same accessors):
+     * window's X are X values, window's Y are layers coordinates (see
+     * WaterfallData::getOffset(), the layers are in [offset, offset + max history[).
+     * Pixels are QRgb (0xAARRGGBB) values, stride is in pixels. */
+    template <class Data>
+    void render(const Data& data, const QRectF& window,
+                QRgb* const buffer, const int width, const int height, const size_t stride) const;
+
+    template <class Data>
+    QImage render(const Data& data, const QSize& size, const QRectF& window) const
+    {
+        QImage image(size, QImage::Format_ARGB32);
+        render(data, window, reinterpret_cast<QRgb*>(image.bits()),
+               size.width(), size.height(), image.bytesPerLine() / sizeof(QRgb));
+        return image;
+    }
+
+    // whole data
+    template <class Data>
+    QImage render(const Data& data, const QSize& size) const
+    {
+        return render(data, size, QRectF(data.getXMin(), data.getOffset(),
+                                         data.getXMax() - data.getXMin(),
+                                         data.getMaxHistoryLength()));
+    }
+
+    /* Renders a matrix of rowCount layers of cols uniform bins (oldest layer first)
+     * stretched to the image. */
+    template <class T>
+    void renderMatrix(const T* const rows, const size_t rowCount, const size_t cols,
+                      QRgb* const buffer, const int width, const int height, const size_t stride) const;
+
+    template <class T>
+    QImage renderMatrix(const T* const rows, const size_t rowCount, const size_t cols, const QSize& size) const
+    {
+        QImage image(size, QImage::Format_ARGB32);
+        renderMatrix(rows, rowCount, cols, reinterpret_cast<QRgb*>(image.bits()),
+                     size.width(), size.height(), image.bytesPerLine() / sizeof(QRgb));
+        return image;
+    }
+
+    template <class T>
+    inline QRgb color(const T value) const
+    {
+        const double v = double(value);
+        if (std::isnan(v))
+        {
+            return m_background;
+        }
+        const double last = double(s_lutSize - 1);
+        double index = (v - m_rangeMin) * m_lutScale;
+        index = (index > 0.) ? index : 0.;
+        index = (index < last) ? index : last;
+        return lut()[size_t(index)];
+    }
+
+    static const size_t s_lutSize = ColorMaps::LutSize;
+
+protected:
+    /* columns[x]: bin of the pixel column x (-1: none)
+     * rowAt(y): layer of the pixel row y (null: none) */
+    template <class T, class RowAt>
+    void renderRows(RowAt rowAt, const std::vector<long>& columns,
+                    QRgb* const buffer, const int width, const int height, const size_t stride) const
+    {
+        WaterfallParallel::parallelFor(size_t(height), 32, [&](const size_t begin, const size_t end)
+        {
+            for (size_t y = begin; y < end; ++y)
+            {
+                QRgb* const out = buffer + y * stride;
+                const T* const row = rowAt(y);
+                if (!row)
+                {
+                    std::fill(out, out + width, m_background);
+                    continue;
+                }
+                for (int x = 0; x < width; ++x)
+                {
+                    const long col = columns[x];
+                    out[x] = (col < 0) ? m_background : color(row[col]);
+                }
+            }
+        }, m_threadCount);
+    }
+
+    const QRgb* lut() const { return (m_preset) ? m_preset->lut->rgb : m_lut.rgb; }
+
+    const ColorMaps::ColorMap* m_preset = nullptr; // null: m_ctrlPts and m_lut are used
+    ColorMaps::ControlPoints m_ctrlPts;
+    ColorMaps::Lut           m_lut;
+    double m_rangeMin = 0.;
+    double m_rangeMax = 1.;
+    double m_lutScale = double(s_lutSize - 1);
+    QRgb   m_background = 0u; // transparent
+    size_t m_threadCount = 0;
+};
+
+template <class Data>
+void WaterfallRenderer::render(const Data& data, const QRectF& window,
+                               QRgb* const buffer, const int width, const int height, const size_t stride) const
+{
+    typedef typename std::remove_cv<typename std::remove_pointer<
+            decltype(data.getLayer(0))>::type>::type T;
+
+    if (width <= 0 || height <= 0 || window.width() <= 0 || window.height() <= 0)
+    {
+        return;
+    }
+
+    // pixels are sampled at their center
+    const double xMin = data.getXMin();
+    const double xMax = data.getXMax();
+    std::vector<long> columns(width);
+    const double dx = window.width() / width;
+    for (int x = 0; x < width; ++x)
+    {
+        const double value = window.left() + (x + 0.5) * dx;
+        columns[x] = (value >= xMin && value < xMax) ? long(data.getColumn(value)) : -1;
+    }
+
+    const double offset = data.getOffset();
+    const double maxHistory = double(data.getMaxHistoryLength());
+    const double dy = window.height() / height;
+    const double yTop = window.top() + window.height();
+    renderRows<T>([&](const size_t y) -> const T*
+    {
+        const double row = std::floor(yTop - (y + 0.5) * dy - offset);
+        return (row >= 0. && row < maxHistory) ? data.getLayer(size_t(row)) : nullptr;
+    }, columns, buffer, width, height, stride);
+}
+
+template <class T>
+void WaterfallRenderer::renderMatrix(const T* const rows, const size_t rowCount, const size_t cols,
+                                     QRgb* const buffer, const int width, const int height, const size_t stride) const
+{
+    if (width <= 0 || height <= 0 || rowCount == 0 || cols == 0)
+    {
+        return;
+    }
+
+    std::vector<long> columns(width);
+    for (int x = 0; x < width; ++x)
+    {
+        columns[x] = long((x + 0.5) * cols / width);
+    }
+
+    renderRows<T>([&](const size_t y) -> const T*
+    {
+        const size_t row = size_t((y + 0.5) * rowCount / height);
+        return rows + (rowCount - 1 - std::min(row, rowCount - 1)) * cols;
+    }, columns, buffer, width, height, stride);
+}
+
+#endif // WATERFALLRENDERER_H
@@ -0,0 +1,354 @@
+#include "WaterfallSession.h"
+
+#include <QSaveFile>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+
+const char    s_magic[8] = "QWFSESS";
+const quint32 s_version = 1;
+const quint32 s_byteOrder = 0x01020304;
+const quint64 s_pageSize = 4096; // alignment of the values and timestamps
+const size_t  s_chunkSize = 4 * 1024 * 1024;
+const char    s_changed[] = "The data was resized or cleared during the save.";
+
+quint64 alignToPage(const quint64 pos)
+{
+    return (pos + s_pageSize - 1) / s_pageSize * s_pageSize;
+}
+
+// [pos, pos + count * size[ inside the file, without overflow
+bool fits(const quint64 pos, const quint64 count, const quint64 size, const quint64 fileSize)
+{
+    return pos <= fileSize && count <= (fileSize - pos) / size;
+}
+
+bool writeBytes(QSaveFile& file, const void* const data, const quint64 bytes, QString& error)
+{
+    const char* const bytesData = static_cast<const char*>(data);
+    for (quint64 done = 0; done < bytes; done += s_chunkSize)
+    {
+        const qint64 count = qint64(std::min<quint64>(s_chunkSize, bytes - done));
+        if (file.write(bytesData + done, count) != count)
+        {
+            error = file.errorString();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool writeAt(QSaveFile& file, const quint64 pos, const void* const data, const quint64 bytes, QString& error)
+{
+    if (!file.seek(qint64(pos)))
+    {
+        error = file.errorString();
+        return false;
+    }
+    return writeBytes(file, data, bytes, error);
+}
+
+}
+
+WaterfallSessionFile::~WaterfallSessionFile()
+{
+    if (m_map)
+    {
+        m_file.unmap(m_map);
+    }
+}
+
+std::unique_ptr<WaterfallSessionFile> WaterfallSessionFile::open(const QString& fileName, QString& error)
+{
+    std::unique_ptr<WaterfallSessionFile> session(new WaterfallSessionFile(fileName));
+    if (!session->map(error))
+    {
+        return nullptr;
+    }
+    return session;
+}
+
+bool WaterfallSessionFile::map(QString& error)
+{
+    if (!m_file.open(QIODevice::ReadOnly))
+    {
+        error = m_file.errorString();
+        return false;
+    }
+
+    const quint64 fileSize = quint64(m_file.size());
+    if (fileSize < sizeof(WaterfallSessionHeader))
+    {
+        error = "Not a waterfall session file.";
+        return false;
+    }
+
+    // the mapping stays valid while the file is open (private: the pages written are copies)
+    m_map = m_file.map(0, qint64(fileSize), QFileDevice::MapPrivateOption);
+    if (!m_map)
+    {
+        error = m_file.errorString();
+        return false;
+    }
+
+    const WaterfallSessionHeader& h = header();
+    if (std::memcmp(h.magic, s_magic, sizeof(s_magic)) != 0)
+    {
+        error = "Not a waterfall session file.";
+        return false;
+    }
+    if (h.version != s_version || h.byteOrder != s_byteOrder ||
+        h.valueSize != sizeof(double) || h.timestampSize != sizeof(time_t))
+    {
+        error = "Waterfall session saved by another version or platform.";
+        return false;
+    }
+
+    const quint64 cells = h.layerPoints * h.maxHistoryLength;
+    const bool valid = h.layerPoints > 0 && h.maxHistoryLength > 0 &&
+                       cells / h.layerPoints == h.maxHistoryLength &&
+                       h.historyLength <= h.maxHistoryLength &&
+                       h.fileSize == fileSize &&
+                       (h.binEdgesCount == 0 || h.binEdgesCount == h.layerPoints + 1) &&
+                       fits(h.binEdgesPos, h.binEdgesCount, sizeof(double), fileSize) &&
+                       fits(h.controlPointsPos, h.controlPointsCount, 4 * sizeof(double), fileSize) &&
+                       fits(h.valuesPos, cells, sizeof(double), fileSize) &&
+                       fits(h.timestampsPos, h.maxHistoryLength, sizeof(time_t), fileSize) &&
+                       h.valuesPos % sizeof(double) == 0 && h.timestampsPos % sizeof(time_t) == 0 &&
+                       h.binEdgesPos % sizeof(double) == 0 && h.controlPointsPos % sizeof(double) == 0 &&
+                       std::memchr(h.colorMap, '\0', sizeof(h.colorMap)) != nullptr;
+    if (!valid)
+    {
+        error = "Corrupted waterfall session file.";
+        return false;
+    }
+    if (h.colorMap[0] != '\0' && !ColorMaps::findPreset(h.colorMap))
+    {
+        error = QString("Unknown color map '%1'.").arg(h.colorMap);
+        return false;
+    }
+
+    return true;
+}
+
+std::vector<double> WaterfallSessionFile::binEdges() const
+{
+    const double* const edges = reinterpret_cast<const double*>(m_map + header().binEdgesPos);
+    return std::vector<double>(edges, edges + header().binEdgesCount);
+}
+
+WaterfallSessionView WaterfallSessionFile::view() const
+{
+    const WaterfallSessionHeader& h = header();
+
+    WaterfallSessionView view;
+    view.zMin = h.zMin;
+    view.zMax = h.zMax;
+    view.markerX = h.markerX;
+    view.markerY = h.markerY;
+    if (h.colorMap[0] != '\0')
+    {
+        view.preset = ColorMaps::findPreset(h.colorMap);
+    }
+    else
+    {
+        const double* const points = reinterpret_cast<const double*>(m_map + h.controlPointsPos);
+        for (size_t i = 0; i < h.controlPointsCount; ++i)
+        {
+            view.colors.emplace_back(points[4 * i], points[4 * i + 1], points[4 * i + 2], points[4 * i + 3]);
+        }
+    }
+    return view;
+}
+
+WaterfallSessionWriter::WaterfallSessionWriter(QObject* const parent /*= nullptr*/) :
+    QObject(parent),
+    m_running(false)
+{
+}
+
+WaterfallSessionWriter::~WaterfallSessionWriter()
+{
+    wait();
+}
+
+void WaterfallSessionWriter::wait()
+{
+    if (m_worker.joinable())
+    {
+        m_worker.join();
+    }
+}
+
+bool WaterfallSessionWriter::start(const WaterfallData<double>& data, const WaterfallSessionView& view,
+                                   const QString& fileName)
+{
+    if (m_running)
+    {
+        return false;
+    }
+    wait(); // previous save
+
+    m_running = true;
+
+    // the signal is queued to the receivers' thread
+    m_worker = std::thread([this, &data, view, fileName]()
+    {
+        QString error;
+        const bool success = write(data, view, fileName, error);
+
+        m_running = false;
+        emit finished(success, error);
+    });
+
+    return true;
+}
+
+bool WaterfallSessionWriter::write(const WaterfallData<double>& data, const WaterfallSessionView& view,
+                                   const QString& fileName, QString& error)
+{
+    // the whole history (clamped by view() to the dimensions at the time it's taken)
+    const size_t all = std::numeric_limits<size_t>::max();
+    const WaterfallData<double>::View rows = data.view(0, all, 0, all);
+    if (!rows.isValid())
+    {
+        error = "No data to save.";
+        return false;
+    }
+
+    WaterfallSessionHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, s_magic, sizeof(s_magic));
+    header.version = s_version;
+    header.byteOrder = s_byteOrder;
+    header.valueSize = sizeof(double);
+    header.timestampSize = sizeof(time_t);
+    header.layerPoints = rows.cols();
+    header.maxHistoryLength = rows.rows();
+    header.historyLength = rows.filledRows();
+    header.offset = rows.offset();
+    header.zMin = view.zMin;
+    header.zMax = view.zMax;
+    header.markerX = view.markerX;
+    header.markerY = view.markerY;
+    if (view.preset)
+    {
+        std::strncpy(header.colorMap, view.preset->name, sizeof(header.colorMap) - 1);
+    }
+
+    // the bins are read with the data pinned
+    std::vector<double> binEdges;
+    if (!rows.read(0, 0, [&](const size_t)
+        {
+            header.xMin = data.getXMin();
+            header.xMax = data.getXMax();
+            binEdges = data.getBinEdges();
+        }))
+    {
+        error = s_changed;
+        return false;
+    }
+
+    std::vector<double> controlPoints;
+    if (!view.preset)
+    {
+        for (const ColorMaps::ControlPoint& point : view.colors)
+        {
+            controlPoints.insert(controlPoints.end(), { std::get<0>(point), std::get<1>(point),
+                                                        std::get<2>(point), std::get<3>(point) });
+        }
+    }
+
+    const size_t layerPoints = rows.cols();
+    const quint64 edgesBytes = binEdges.size() * sizeof(double);
+    const quint64 pointsBytes = controlPoints.size() * sizeof(double);
+    const quint64 rowBytes = layerPoints * sizeof(double);
+    header.binEdgesCount = binEdges.size();
+    header.controlPointsCount = controlPoints.size() / 4;
+    header.binEdgesPos = sizeof(header);
+    header.controlPointsPos = header.binEdgesPos + edgesBytes;
+    header.valuesPos = alignToPage(header.controlPointsPos + pointsBytes);
+    header.timestampsPos = alignToPage(header.valuesPos + rows.rows() * rowBytes);
+    header.fileSize = header.timestampsPos + rows.rows() * sizeof(time_t);
+
+    // the file is allocated first (zeroed: padding and empty rows), then written at the
+    // right places, the header last
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        error = file.errorString();
+        return false;
+    }
+    if (!file.resize(qint64(header.fileSize)))
+    {
+        error = file.errorString();
+        file.cancelWriting();
+        return false;
+    }
+    if (!writeAt(file, header.binEdgesPos, binEdges.data(), edgesBytes, error) ||
+        !writeAt(file, header.controlPointsPos, controlPoints.data(), pointsBytes, error))
+    {
+        file.cancelWriting();
+        return false;
+    }
+
+    /* the rows are copied from the storage by chunks, the data being pinned for each one
+     * only (not while it's written), newest rows first: the layers added meanwhile
+     * overwrite the oldest rows, which are saved empty */
+    std::vector<time_t> timestamps(rows.rows(), 0);
+    std::vector<double> chunk;
+    const size_t chunkRows = std::max(size_t(s_chunkSize / rowBytes), size_t(1));
+    size_t firstValid = 0;
+    for (size_t end = rows.rows(); end > firstValid; )
+    {
+        const size_t begin = (end - firstValid > chunkRows) ? end - chunkRows : firstValid;
+        size_t first = end;
+        const bool current = rows.read(begin, end, [&](const size_t valid)
+        {
+            first = valid;
+            chunk.resize((end - first) * layerPoints);
+            for (size_t row = first; row < end; ++row)
+            {
+                const double* const layer = rows.row(row);
+                std::copy(layer, layer + layerPoints, chunk.begin() + (row - first) * layerPoints);
+                timestamps[row] = rows.timestamp(row);
+            }
+        });
+        if (!current)
+        {
+            error = s_changed;
+            file.cancelWriting();
+            return false;
+        }
+        if (!writeAt(file, header.valuesPos + first * rowBytes, chunk.data(), (end - first) * rowBytes, error))
+        {
+            file.cancelWriting();
+            return false;
+        }
+
+        if (first > begin)
+        {
+            firstValid = first; // the older rows were overwritten
+        }
+        end = begin;
+    }
+    header.historyLength = std::min<quint64>(header.historyLength, rows.rows() - firstValid);
+
+    if (!writeAt(file, header.timestampsPos, timestamps.data(), rows.rows() * sizeof(time_t), error) ||
+        !writeAt(file, 0, &header, sizeof(header), error))
+    {
+        file.cancelWriting();
+        return false;
+    }
+
+    if (!file.commit())
+    {
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,136 @@
+#ifndef WATERFALLSESSION_H
+#define WATERFALLSESSION_H
+
+#include <QFile>
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+#include <ctime>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "ColorMaps.h"
+#include "WaterfallData.h"
+
+/* Session files: the whole state of a WaterfallData (dimensions, bins, ring
+ * buffer and timestamps) and the settings of the view that saved it (range,
+ * color map, marker), restored at startup without any parsing nor copy.
+ *
+ * Layout (native byte order and sizes, checked when the file is opened):
+ *  - WaterfallSessionHeader,
+ *  - the bin edges (float64, layerPoints + 1, non-uniform bins only),
+ *  - the color map control points (x, r, g, b as float64, unless a preset is named),
+ *  - the values (float64, maxHistoryLength x layerPoints, oldest row first: the
+ *    empty rows come first, then the filled ones) and the timestamps (time_t, one
+ *    per row), both page aligned.
+ * That's the ring buffer of a WaterfallData whose head is 0: the restored data
+ * uses the mapped file as its storage (copy-on-write), the rows are only read
+ * from disk when they're needed and the layers added afterwards never modify it.
+ */
+struct WaterfallSessionHeader
+{
+    char    magic[8];           // "QWFSESS"
+    quint32 version;
+    quint32 byteOrder;          // 0x01020304 written natively
+    quint32 valueSize;          // sizeof(double)
+    quint32 timestampSize;      // sizeof(time_t)
+    quint64 layerPoints;
+    quint64 maxHistoryLength;
+    quint64 historyLength;      // filled rows (the last ones)
+    double  offset;             // Y of the first row
+    double  xMin;
+    double  xMax;
+    double  zMin;               // range of the view
+    double  zMax;
+    double  markerX;
+    double  markerY;            // row of the marker (0: oldest)
+    char    colorMap[32];       // preset name, empty: control points
+    quint64 binEdgesCount;      // 0: uniform bins
+    quint64 controlPointsCount;
+    quint64 binEdgesPos;        // byte offsets in the file
+    quint64 controlPointsPos;
+    quint64 valuesPos;
+    quint64 timestampsPos;
+    quint64 fileSize;
+};
+
+// settings of the view saved with the data
+struct WaterfallSessionView
+{
+    double                     zMin = 0.;
+    double                     zMax = 0.;
+    const ColorMaps::ColorMap* preset = nullptr; // null: colors
+    ColorMaps::ControlPoints   colors;
+    double                     markerX = 0.;
+    double                     markerY = 0.;
+};
+
+/* Mapped session file (see WaterfallStore): the values and timestamps are the
+ * storage of the restored data, they must live as long as it. */
+class WaterfallSessionFile
+{
+public:
+    ~WaterfallSessionFile();
+
+    // nullptr (and error) if the file can't be mapped or isn't a valid session of this platform
+    static std::unique_ptr<WaterfallSessionFile> open(const QString& fileName, QString& error);
+
+    const WaterfallSessionHeader& header() const { return *reinterpret_cast<const WaterfallSessionHeader*>(m_map); }
+    std::vector<double> binEdges() const;
+    WaterfallSessionView view() const;
+
+    // copy-on-write: writing them never modifies the file
+    double* values() { return reinterpret_cast<double*>(m_map + header().valuesPos); }
+    time_t* timestamps() { return reinterpret_cast<time_t*>(m_map + header().timestampsPos); }
+
+protected:
+    explicit WaterfallSessionFile(const QString& fileName) : m_file(fileName) {}
+    bool map(QString& error);
+
+    QFile  m_file;
+    uchar* m_map = nullptr;
+
+private:
+    WaterfallSessionFile(const WaterfallSessionFile&) = delete;
+    WaterfallSessionFile& operator=(const WaterfallSessionFile&) = delete;
+};
+
+/* Saves sessions, on a worker thread for the autosave: the rows are written
+ * straight from the storage by chunks (the data is pinned while a chunk is
+ * copied to a small buffer, not while it's written) through QSaveFile so an
+ * interrupted save leaves the previous file intact. A restored file can be
+ * saved again while it's mapped (the new file replaces it, the mapping keeps
+ * the old one), except on Windows where a mapped file can't be replaced: save
+ * to another file there (the demo saves to a sibling file that replaces the
+ * session at the next startup). */
+class WaterfallSessionWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit WaterfallSessionWriter(QObject* const parent = nullptr);
+    ~WaterfallSessionWriter() override;
+
+    // synchronous save (can be called from another thread than the one adding data)
+    static bool write(const WaterfallData<double>& data, const WaterfallSessionView& view,
+                      const QString& fileName, QString& error);
+
+    // returns false if a save is already running, data must outlive the save (see wait())
+    bool start(const WaterfallData<double>& data, const WaterfallSessionView& view, const QString& fileName);
+    bool isRunning() const { return m_running; }
+    void wait();
+
+signals:
+    void finished(const bool success, const QString& error);
+
+protected:
+    std::thread       m_worker;
+    std::atomic<bool> m_running;
+
+private:
+    Q_DISABLE_COPY(WaterfallSessionWriter)
+};
+
+#endif // WATERFALLSESSION_H
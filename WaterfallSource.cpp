@@ -0,0 +1,289 @@
+#include "WaterfallSource.h"
+
+#include <QSerialPort>
+#include <QSocketNotifier>
+#include <QStringList>
+#include <QTcpSocket>
+#include <QUdpSocket>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Waterfallplot.h"
+
+WaterfallSource::WaterfallSource(Waterfallplot* const waterfall, QObject* const parent /*= nullptr*/) :
+    QObject(parent),
+    m_waterfall(waterfall),
+    m_readBuffer(64 * 1024)
+{
+}
+
+WaterfallSource::~WaterfallSource()
+{
+    close();
+}
+
+bool WaterfallSource::open(const QString& spec)
+{
+    const QStringList parts = spec.split(':');
+    const QString type = parts.front().toLower();
+
+    if (type == "serial" && parts.size() >= 2)
+    {
+        return openSerial(parts[1], (parts.size() > 2) ? parts[2].toInt() : 115200);
+    }
+    if (type == "tcp" && parts.size() == 3)
+    {
+        return openTcp(parts[1], quint16(parts[2].toUInt()));
+    }
+    if (type == "udp" && parts.size() == 2)
+    {
+        return openUdp(quint16(parts[1].toUInt()));
+    }
+    if (type == "pipe" && parts.size() >= 2)
+    {
+        return openPipe(spec.mid(5));
+    }
+
+    m_error = QString("Unknown source '%1'.").arg(spec);
+    return false;
+}
+
+bool WaterfallSource::openSerial(const QString& portName, const int baudRate /*= 115200*/)
+{
+    close();
+
+    QSerialPort* const port = new QSerialPort(portName, this);
+    port->setBaudRate(baudRate);
+    if (!port->open(QIODevice::ReadOnly))
+    {
+        m_error = port->errorString();
+        delete port;
+        return false;
+    }
+
+    setupDevice(port);
+    return true;
+}
+
+bool WaterfallSource::openTcp(const QString& host, const quint16 port)
+{
+    close();
+
+    if (host.isEmpty() || port == 0)
+    {
+        m_error = QString("Invalid TCP address '%1:%2'.").arg(host).arg(port);
+        return false;
+    }
+
+    QTcpSocket* const socket = new QTcpSocket(this);
+    connect(socket, &QTcpSocket::disconnected, this, [this]()
+    {
+        m_parser.reset(); // a partial frame can't be completed by the next connection
+        emit errorOccurred("Disconnected.");
+    });
+
+    // the connection is asynchronous: refused, unknown host, timeout... are reported here
+    const auto socketError = [this, socket](const QAbstractSocket::SocketError error)
+    {
+        if (error == QAbstractSocket::RemoteHostClosedError)
+        {
+            return; // disconnected() follows
+        }
+        m_error = socket->errorString();
+        emit errorOccurred(m_error);
+    };
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    connect(socket, &QAbstractSocket::errorOccurred, this, socketError);
+#else
+    connect(socket, static_cast<void (QAbstractSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error),
+            this, socketError);
+#endif
+    socket->connectToHost(host, port, QIODevice::ReadOnly);
+
+    setupDevice(socket);
+    return true;
+}
+
+bool WaterfallSource::openUdp(const quint16 port)
+{
+    close();
+
+    m_udp = new QUdpSocket(this);
+    if (!m_udp->bind(QHostAddress::Any, port))
+    {
+        m_error = m_udp->errorString();
+        delete m_udp;
+        m_udp = nullptr;
+        return false;
+    }
+
+    connect(m_udp, &QUdpSocket::readyRead, this, &WaterfallSource::readDatagrams);
+    m_device = m_udp;
+    return true;
+}
+
+bool WaterfallSource::openPipe(const QString& path)
+{
+    close();
+
+#ifdef Q_OS_UNIX
+    // non blocking: opening a FIFO doesn't wait for a writer and reads never block the GUI.
+    // A FIFO is opened for writing too: as long as we hold a writer end, the writers
+    // can come and go without the FIFO ever reaching EOF.
+    const QByteArray localPath = path.toLocal8Bit();
+    struct stat info;
+    const bool fifo = (::stat(localPath.constData(), &info) == 0 && S_ISFIFO(info.st_mode));
+    m_fd = ::open(localPath.constData(), ((fifo) ? O_RDWR : O_RDONLY) | O_NONBLOCK);
+    if (m_fd < 0)
+    {
+        m_error = QString("Can't open %1.").arg(path);
+        return false;
+    }
+
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &WaterfallSource::readPipe);
+    return true;
+#else
+    Q_UNUSED(path)
+    m_error = "Pipes are only supported on Unix.";
+    return false;
+#endif
+}
+
+void WaterfallSource::close()
+{
+    if (m_device)
+    {
+        m_device->disconnect(this);
+        m_device->close();
+        m_device->deleteLater();
+        m_device = nullptr;
+        m_udp = nullptr;
+    }
+
+#ifdef Q_OS_UNIX
+    if (m_fd >= 0)
+    {
+        delete m_notifier;
+        m_notifier = nullptr;
+        ::close(m_fd);
+        m_fd = -1;
+    }
+#endif
+
+    m_parser.reset();
+}
+
+void WaterfallSource::setupDevice(QIODevice* const device)
+{
+    m_device = device;
+    connect(device, &QIODevice::readyRead, this, &WaterfallSource::readDevice);
+}
+
+void WaterfallSource::readDevice()
+{
+    for (;;)
+    {
+        const qint64 read = m_device->read(m_readBuffer.data(), qint64(m_readBuffer.size()));
+        if (read <= 0)
+        {
+            break;
+        }
+        consume(m_readBuffer.data(), size_t(read));
+    }
+    flush();
+}
+
+void WaterfallSource::readDatagrams()
+{
+    // a datagram is expected to contain whole frames
+    while (m_udp->hasPendingDatagrams())
+    {
+        const qint64 size = m_udp->pendingDatagramSize();
+        if (size > qint64(m_readBuffer.size()))
+        {
+            m_readBuffer.resize(size_t(size));
+        }
+        const qint64 read = m_udp->readDatagram(m_readBuffer.data(), qint64(m_readBuffer.size()));
+        if (read > 0)
+        {
+            consume(m_readBuffer.data(), size_t(read));
+        }
+    }
+    flush();
+}
+
+void WaterfallSource::readPipe()
+{
+#ifdef Q_OS_UNIX
+    for (;;)
+    {
+        const ssize_t read = ::read(m_fd, m_readBuffer.data(), m_readBuffer.size());
+        if (read > 0)
+        {
+            consume(m_readBuffer.data(), size_t(read));
+            continue;
+        }
+        if (read == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            // end of a file or of a pipe whose writer closed it (not of a FIFO, see openPipe()):
+            // nothing more will come, stop watching it (it stays readable at EOF otherwise)
+            m_notifier->setEnabled(false);
+            flush();
+            emit errorOccurred("End of stream.");
+            return;
+        }
+        if (errno != EINTR)
+        {
+            break;
+        }
+    }
+    flush();
+#endif
+}
+
+void WaterfallSource::consume(const char* data, size_t length)
+{
+    while (length > 0)
+    {
+        const size_t used = m_parser.feed(data, length);
+        data += used;
+        length -= used;
+
+        if (m_parser.isBatchFull())
+        {
+            // the slots are given to the waterfall and reused
+            for (size_t i = 0; i < m_parser.count(); ++i)
+            {
+                m_waterfall->addData(m_parser.layer(i), m_parser.points(i), m_parser.timestamp(i));
+            }
+            m_batchLayers += int(m_parser.count());
+            m_parser.clearBatch();
+        }
+    }
+}
+
+void WaterfallSource::flush()
+{
+    for (size_t i = 0; i < m_parser.count(); ++i)
+    {
+        m_waterfall->addData(m_parser.layer(i), m_parser.points(i), m_parser.timestamp(i));
+    }
+    m_batchLayers += int(m_parser.count());
+    m_parser.clearBatch();
+
+    if (m_batchLayers > 0)
+    {
+        if (m_replot)
+        {
+            m_waterfall->replot();
+        }
+        emit layersAdded(m_batchLayers);
+        m_batchLayers = 0;
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef WATERFALLSOURCE_H
+#define WATERFALLSOURCE_H
+
+#include <QObject>
+#include <QString>
+
+#include <vector>
+
+#include "WaterfallFrameParser.h"
+
+class QIODevice;
+class QSocketNotifier;
+class QUdpSocket;
+class Waterfallplot;
+
+/* Streams framed layers (see WaterfallFrameParser for the frame format) from
+ * a serial port, a TCP/UDP socket or a pipe/FIFO into a Waterfallplot.
+ * The device is read into a fixed buffer and parsed incrementally, every
+ * layer decoded during a read event is added before a single replot.
+ *
+ * Local testing without a device:
+ *  - pty pair: socat -d -d pty,raw,echo=0 pty,raw,echo=0, then openSerial()
+ *    on one end and write frames to the other one,
+ *  - loopback: openTcp("127.0.0.1", port) with a local server sending frames
+ *    or openUdp(port) and send a frame per datagram to 127.0.0.1
+ *    (waterfall_source_test does the TCP one).
+ */
+class WaterfallSource : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit WaterfallSource(Waterfallplot* const waterfall, QObject* const parent = nullptr);
+    ~WaterfallSource() override;
+
+    bool openSerial(const QString& portName, const int baudRate = 115200);
+    // asynchronous: true once the connection is started, its failure is reported by errorOccurred()
+    bool openTcp(const QString& host, const quint16 port);
+    bool openUdp(const quint16 port);
+    bool openPipe(const QString& path); // FIFO (writers may come and go) or pipe (Unix), a regular file is read once
+
+    // "serial:/dev/ttyUSB0[:baud]", "tcp:host:port", "udp:port" or "pipe:/path"
+    bool open(const QString& spec);
+    void close();
+    bool isOpen() const { return m_device != nullptr || m_fd >= 0; }
+    QString errorString() const { return m_error; }
+
+    // a replot is done after every batch of decoded layers (default: true)
+    void setReplotEnabled(const bool enabled) { m_replot = enabled; }
+
+    const WaterfallFrameParser& parser() const { return m_parser; }
+
+signals:
+    void layersAdded(const int count);
+    void errorOccurred(const QString& error);
+
+protected:
+    void setupDevice(QIODevice* const device);
+    void readDevice();
+    void readDatagrams();
+    void readPipe();
+    void consume(const char* data, size_t length);
+    void flush();
+
+    Waterfallplot* const  m_waterfall;
+    WaterfallFrameParser  m_parser;
+    std::vector<char>     m_readBuffer; // preallocated, reused for every read
+
+    QIODevice*       m_device = nullptr;
+    QUdpSocket*      m_udp = nullptr;
+    int              m_fd = -1;
+    QSocketNotifier* m_notifier = nullptr;
+    bool             m_replot = true;
+    int              m_batchLayers = 0;
+    QString          m_error;
+
+private:
+    Q_DISABLE_COPY(WaterfallSource)
+};
+
+#endif // WATERFALLSOURCE_H
@@ -0,0 +1,244 @@
+/* waterfall_source_test: checks WaterfallSource end to end (run by ctest).
+ *  - tcp: a loopback server sends frames of known layers (every sample type,
+ *    small writes, garbage between some of them) which must be decoded into
+ *    the history,
+ *  - refused: a connection to a closed port must be reported,
+ *  - fifo (Unix): a FIFO keeps being read after its first writer left.
+ *
+ * Runs headless: the offscreen QPA platform is used unless QT_QPA_PLATFORM is set.
+ * Exits with 1 if a check fails.
+ */
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QTimer>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "WaterfallData.h"
+#include "WaterfallFrameParser.h"
+#include "WaterfallSource.h"
+#include "Waterfallplot.h"
+
+namespace
+{
+
+const size_t s_layerPoints = 16;
+const size_t s_frames = 100;
+
+// layer f: (f + i) % 200 at bin i, timestamp 1000 + f
+QByteArray encodeFrames(const size_t firstFrame, const size_t frames)
+{
+    const WaterfallFrameParser::SampleType types[] = { WaterfallFrameParser::Float32, WaterfallFrameParser::Float64,
+                                                       WaterfallFrameParser::Int16, WaterfallFrameParser::UInt8 };
+
+    QByteArray stream;
+    std::vector<double> values(s_layerPoints);
+    for (size_t f = firstFrame; f < firstFrame + frames; ++f)
+    {
+        for (size_t i = 0; i < s_layerPoints; ++i)
+        {
+            values[i] = double((f + i) % 200);
+        }
+        const std::vector<char> frame = WaterfallFrameParser::encode(values.data(), s_layerPoints,
+                                                                     time_t(1000 + f), types[f % 4]);
+        stream.append(frame.data(), int(frame.size()));
+        if (f % 10 == 0)
+        {
+            stream.append("garbage");
+        }
+    }
+    return stream;
+}
+
+// the history holds the layers, oldest first
+size_t countMismatches(const Waterfallplot& plot)
+{
+    size_t mismatches = 0;
+    const WaterfallData<double>::View view = plot.data()->view(0, s_frames, 0, s_layerPoints);
+    view.read(0, view.rows(), [&](const size_t first)
+    {
+        mismatches += first;
+        for (size_t f = first; f < view.rows(); ++f)
+        {
+            mismatches += (view.timestamp(f) != time_t(1000 + f));
+            for (size_t i = 0; i < s_layerPoints; ++i)
+            {
+                mismatches += (view.at(f, i) != double((f + i) % 200));
+            }
+        }
+    });
+    return mismatches;
+}
+
+// processes the events until done() or the timeout
+bool waitFor(const std::function<bool()>& done, const int msecs = 5000)
+{
+    QTimer tick; // wakes the loop up
+    tick.start(20);
+    QElapsedTimer timer;
+    timer.start();
+    while (!done() && timer.elapsed() < msecs)
+    {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+    return done();
+}
+
+bool report(const char* const check, const bool passed, const QString& details)
+{
+    std::cout << check << ": " << ((passed) ? "passed" : "FAILED") << " (" << details.toStdString() << ")"
+              << std::endl;
+    return passed;
+}
+
+bool checkTcp()
+{
+    const QByteArray stream = encodeFrames(0, s_frames);
+
+    Waterfallplot plot(nullptr);
+    plot.setDataDimensions(0, 500, s_frames, s_layerPoints);
+
+    QTcpServer server;
+    server.listen(QHostAddress::LocalHost);
+    QObject::connect(&server, &QTcpServer::newConnection, [&]()
+    {
+        QTcpSocket* const client = server.nextPendingConnection();
+        // small writes: the frames are split between reads
+        for (int pos = 0; pos < stream.size(); pos += 61)
+        {
+            client->write(stream.constData() + pos, std::min(61, stream.size() - pos));
+            client->flush();
+        }
+    });
+
+    WaterfallSource source(&plot);
+    source.setReplotEnabled(false);
+    size_t received = 0;
+    QObject::connect(&source, &WaterfallSource::layersAdded, [&](const int count)
+    {
+        received += size_t(count);
+    });
+    const bool opened = source.openTcp("127.0.0.1", server.serverPort());
+    if (opened)
+    {
+        waitFor([&]() { return received >= s_frames; });
+    }
+
+    const size_t mismatches = countMismatches(plot);
+    return report("tcp", opened && received == s_frames && mismatches == 0,
+                  QString("%1 layers, %2 mismatches, %3 bytes skipped")
+                  .arg(received).arg(mismatches).arg(source.parser().skippedBytes()));
+}
+
+bool checkRefused()
+{
+    Waterfallplot plot(nullptr);
+    plot.setDataDimensions(0, 500, s_frames, s_layerPoints);
+
+    // nobody listens on the port of a closed server
+    QTcpServer closed;
+    closed.listen(QHostAddress::LocalHost);
+    const quint16 closedPort = closed.serverPort();
+    closed.close();
+
+    WaterfallSource source(&plot);
+    QString refusal;
+    QObject::connect(&source, &WaterfallSource::errorOccurred, [&](const QString& error)
+    {
+        refusal = error;
+    });
+    if (source.openTcp("127.0.0.1", closedPort))
+    {
+        waitFor([&]() { return !refusal.isEmpty(); });
+    }
+
+    return report("refused", !refusal.isEmpty() && refusal == source.errorString(), refusal);
+}
+
+#ifdef Q_OS_UNIX
+// a writer of the FIFO, gone once the frames are written
+bool writeFifo(const QByteArray& path, const QByteArray& stream)
+{
+    const int fd = ::open(path.constData(), O_WRONLY | O_NONBLOCK); // the source is the reader
+    if (fd < 0)
+    {
+        return false;
+    }
+    const bool written = (::write(fd, stream.constData(), size_t(stream.size())) == ssize_t(stream.size()));
+    ::close(fd);
+    return written;
+}
+
+bool checkFifo()
+{
+    QTemporaryDir dir;
+    const QByteArray path = dir.filePath("frames.fifo").toLocal8Bit();
+    if (!dir.isValid() || ::mkfifo(path.constData(), 0600) != 0)
+    {
+        return report("fifo", false, "can't create the FIFO");
+    }
+
+    Waterfallplot plot(nullptr);
+    plot.setDataDimensions(0, 500, s_frames, s_layerPoints);
+
+    WaterfallSource source(&plot);
+    source.setReplotEnabled(false);
+    size_t received = 0;
+    QObject::connect(&source, &WaterfallSource::layersAdded, [&](const int count)
+    {
+        received += size_t(count);
+    });
+    QString error;
+    QObject::connect(&source, &WaterfallSource::errorOccurred, [&](const QString& message)
+    {
+        error = message;
+    });
+    if (!source.openPipe(QString::fromLocal8Bit(path)))
+    {
+        return report("fifo", false, source.errorString());
+    }
+
+    // two writers one after the other (frames at the writers boundary are whole)
+    const size_t half = s_frames / 2;
+    bool written = writeFifo(path, encodeFrames(0, half));
+    waitFor([&]() { return received >= half; });
+    written = written && writeFifo(path, encodeFrames(half, s_frames - half));
+    waitFor([&]() { return received >= s_frames; });
+
+    const size_t mismatches = countMismatches(plot);
+    return report("fifo", written && received == s_frames && mismatches == 0 && error.isEmpty(),
+                  QString("%1 layers, %2 mismatches%3").arg(received).arg(mismatches)
+                  .arg((error.isEmpty()) ? QString() : ", " + error));
+}
+#endif
+
+}
+
+int main(int argc, char** argv)
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+
+    bool passed = checkTcp();
+    passed = checkRefused() && passed;
+#ifdef Q_OS_UNIX
+    passed = checkFifo() && passed;
+#endif
+    return (passed) ? 0 : 1;
+}
@@ -0,0 +1,228 @@
+#ifndef WATERFALLSTATISTICS_H
+#define WATERFALLSTATISTICS_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/* Per-column (bin) statistics over the rolling history of the waterfall.
+ * Accumulators are updated when a layer is inserted and when the oldest one
+ * is evicted, so the cost is O(layerPoints) per layer whatever the history
+ * length:
+ *  - mean and variance use Welford's algorithm (and its inverse for removal),
+ *  - the noise floor (median by default) comes from a histogram sketch per
+ *    column over a fixed value range, which supports removals unlike P^2 or
+ *    t-digest like sketches. Its resolution is (max - min) / bins.
+ * Derived arrays (stddev, noise floor) are computed lazily when requested.
+ */
+template <class T>
+class WaterfallStatistics
+{
+public:
+    void setup(const size_t layerPoints, double sketchMin, double sketchMax, const size_t sketchBins = 64)
+    {
+        if (sketchMin > sketchMax)
+        {
+            std::swap(sketchMin, sketchMax);
+        }
+        if (sketchMin == sketchMax)
+        {
+            sketchMax = sketchMin + 1;
+        }
+
+        m_sketchMin = sketchMin;
+        m_sketchMax = sketchMax;
+        m_sketchBins = std::max(sketchBins, size_t(2));
+        m_sketchScale = m_sketchBins / (m_sketchMax - m_sketchMin);
+
+        m_mean.assign(layerPoints, 0.);
+        m_m2.assign(layerPoints, 0.);
+        m_stddev.assign(layerPoints, 0.);
+        m_noiseFloor.assign(layerPoints, 0.);
+        m_sketch.assign(layerPoints * m_sketchBins, 0);
+        m_count = 0;
+        m_dirty = true;
+    }
+
+    double getSketchMin() const { return m_sketchMin; }
+    double getSketchMax() const { return m_sketchMax; }
+    size_t getSketchBins() const { return m_sketchBins; }
+
+    void setEnabled(const bool enabled) { m_enabled = enabled; }
+    bool isEnabled() const { return m_enabled; }
+
+    // quantile used as the noise floor estimate (0.5: median)
+    void setNoiseFloorQuantile(const double q)
+    {
+        m_noiseFloorQuantile = std::min(1., std::max(0., q));
+        m_dirty = true;
+    }
+    double getNoiseFloorQuantile() const { return m_noiseFloorQuantile; }
+
+    void reset()
+    {
+        std::fill(m_mean.begin(), m_mean.end(), 0.);
+        std::fill(m_m2.begin(), m_m2.end(), 0.);
+        std::fill(m_sketch.begin(), m_sketch.end(), 0);
+        m_count = 0;
+        m_dirty = true;
+    }
+
+    // evicted may be null when the history isn't full yet
+    void update(const T* const layer, const T* const evicted, const size_t length)
+    {
+        if (length != m_mean.size())
+        {
+            return;
+        }
+        if (evicted)
+        {
+            remove(evicted);
+        }
+        insert(layer);
+    }
+
+    void insert(const T* const layer)
+    {
+        const size_t n = m_mean.size();
+
+        ++m_count;
+        const double invCount = 1. / m_count;
+        for (size_t i = 0; i < n; ++i)
+        {
+            const double x = double(layer[i]);
+            const double delta = x - m_mean[i];
+            m_mean[i] += delta * invCount;
+            m_m2[i] += delta * (x - m_mean[i]);
+        }
+
+        unsigned* sketch = m_sketch.data();
+        for (size_t i = 0; i < n; ++i, sketch += m_sketchBins)
+        {
+            ++sketch[sketchBin(double(layer[i]))];
+        }
+        m_dirty = true;
+    }
+
+    void remove(const T* const layer)
+    {
+        if (m_count == 0)
+        {
+            return;
+        }
+        if (m_count == 1)
+        {
+            reset();
+            return;
+        }
+
+        const size_t n = m_mean.size();
+
+        const double count = double(m_count);
+        const double invCount = 1. / (m_count - 1);
+        for (size_t i = 0; i < n; ++i)
+        {
+            const double x = double(layer[i]);
+            const double oldMean = (count * m_mean[i] - x) * invCount;
+            m_m2[i] -= (x - oldMean) * (x - m_mean[i]);
+            m_m2[i] = (m_m2[i] > 0.) ? m_m2[i] : 0.; // rounding errors
+            m_mean[i] = oldMean;
+        }
+        --m_count;
+
+        unsigned* sketch = m_sketch.data();
+        for (size_t i = 0; i < n; ++i, sketch += m_sketchBins)
+        {
+            unsigned& bin = sketch[sketchBin(double(layer[i]))];
+            if (bin > 0)
+            {
+                --bin;
+            }
+        }
+        m_dirty = true;
+    }
+
+    size_t size() const { return m_mean.size(); }
+    size_t count() const { return m_count; }
+
+    const double* mean() const { return m_mean.data(); }
+    const double* stddev() const { refresh(); return m_stddev.data(); }
+    const double* noiseFloor() const { refresh(); return m_noiseFloor.data(); }
+
+    // q-quantile of a column estimated from its histogram sketch
+    double quantile(const size_t column, const double q) const
+    {
+        if (m_count == 0 || column >= m_mean.size())
+        {
+            return 0.;
+        }
+
+        const unsigned* sketch = m_sketch.data() + column * m_sketchBins;
+        const double target = q * m_count;
+        const double binWidth = 1. / m_sketchScale;
+
+        double cumulated = 0.;
+        for (size_t bin = 0; bin < m_sketchBins; ++bin)
+        {
+            const double next = cumulated + sketch[bin];
+            if (next >= target && sketch[bin] > 0)
+            {
+                // linear interpolation inside the bin
+                const double fraction = (target - cumulated) / sketch[bin];
+                return m_sketchMin + (bin + fraction) * binWidth;
+            }
+            cumulated = next;
+        }
+        return m_sketchMax;
+    }
+
+protected:
+    size_t sketchBin(const double x) const
+    {
+        if (!(x > m_sketchMin)) // NaN are put in the first bin
+        {
+            return 0;
+        }
+        const size_t bin = size_t((x - m_sketchMin) * m_sketchScale);
+        return (bin < m_sketchBins) ? bin : m_sketchBins - 1;
+    }
+
+    void refresh() const
+    {
+        if (!m_dirty)
+        {
+            return;
+        }
+
+        const size_t n = m_mean.size();
+        const double invCount = (m_count > 1) ? 1. / (m_count - 1) : 0.;
+        for (size_t i = 0; i < n; ++i)
+        {
+            m_stddev[i] = std::sqrt(m_m2[i] * invCount);
+        }
+        for (size_t i = 0; i < n; ++i)
+        {
+            m_noiseFloor[i] = quantile(i, m_noiseFloorQuantile);
+        }
+        m_dirty = false;
+    }
+
+    bool   m_enabled = false;
+    size_t m_count = 0;
+
+    double m_sketchMin = 0.;
+    double m_sketchMax = 1.;
+    double m_sketchScale = 1.;
+    size_t m_sketchBins = 64;
+    double m_noiseFloorQuantile = 0.5;
+
+    std::vector<double>   m_mean;
+    std::vector<double>   m_m2;     // sum of squares of differences from the mean
+    std::vector<unsigned> m_sketch; // layerPoints x sketchBins histograms
+
+    mutable bool                m_dirty = true;
+    mutable std::vector<double> m_stddev;
+    mutable std::vector<double> m_noiseFloor;
+};
+
+#endif // WATERFALLSTATISTICS_H
@@ -0,0 +1,115 @@
+#include "WaterfallStore.h"
+
+#include <algorithm>
+
+bool WaterfallStore::RenderKey::operator==(const RenderKey& other) const
+{
+    return area == other.area && size == other.size &&
+           std::equal(xMap, xMap + 4, other.xMap) && std::equal(yMap, yMap + 4, other.yMap) &&
+           xTransformed == other.xTransformed &&
+           zMin == other.zMin && zMax == other.zMax &&
+           preset == other.preset && colors == other.colors &&
+           colorRing == other.colorRing;
+}
+
+WaterfallStore::WaterfallStore(double dXMin, double dXMax,
+                               const size_t historyExtent,
+                               const size_t layerPoints) :
+    m_data(dXMin, dXMax, historyExtent, layerPoints)
+{
+}
+
+WaterfallStore::WaterfallStore(std::unique_ptr<WaterfallSessionFile> session) :
+    m_session(std::move(session)),
+    m_data(m_session->header().xMin, m_session->header().xMax,
+           size_t(m_session->header().maxHistoryLength), size_t(m_session->header().layerPoints),
+           m_session->values(), m_session->timestamps(),
+           size_t(m_session->header().historyLength), m_session->header().offset)
+{
+    m_data.setBinEdges(m_session->binEdges());
+}
+
+void WaterfallStore::notifyLayerAdded()
+{
+    m_renders.clear();
+    ++m_generation;
+    emit layerAdded();
+}
+
+void WaterfallStore::notifyReset()
+{
+    m_renders.clear();
+    ++m_generation;
+    emit reset();
+}
+
+bool WaterfallStore::findRender(const RenderKey& key, QImage& image) const
+{
+    for (auto it = m_renders.crbegin(); it != m_renders.crend(); ++it)
+    {
+        if (it->key == key)
+        {
+            image = it->image; // implicitly shared, no copy
+            return true;
+        }
+    }
+    return false;
+}
+
+void WaterfallStore::storeRender(const RenderKey& key, const QImage& image)
+{
+    if (m_renders.size() >= s_maxRenders)
+    {
+        m_renders.erase(m_renders.begin());
+    }
+    m_renders.push_back(RenderEntry{ key, image });
+}
+
+void WaterfallStore::setStatisticsEnabled(const bool enabled, const double dLower, const double dUpper)
+{
+    if (!enabled)
+    {
+        m_data.setStatisticsEnabled(false);
+        return;
+    }
+
+    if (!(m_sketchMin < m_sketchMax) && dLower < dUpper)
+    {
+        m_sketchMin = dLower;
+        m_sketchMax = dUpper;
+    }
+
+    // another view may have built it already
+    const WaterfallStatistics<double>& statistics = m_data.statistics();
+    if (statistics.isEnabled() && statistics.getSketchBins() == std::max(m_sketchBins, size_t(2)) &&
+        statistics.getSketchMin() == m_sketchMin && statistics.getSketchMax() == m_sketchMax)
+    {
+        return;
+    }
+    m_data.setStatisticsEnabled(true, m_sketchMin, m_sketchMax, m_sketchBins);
+}
+
+void WaterfallStore::setStatisticsSketch(const double sketchMin, const double sketchMax, const size_t sketchBins)
+{
+    const WaterfallStatistics<double>& statistics = m_data.statistics();
+    m_sketchBins = sketchBins;
+    if (sketchMin < sketchMax)
+    {
+        m_sketchMin = sketchMin;
+        m_sketchMax = sketchMax;
+    }
+    else if (statistics.isEnabled())
+    {
+        m_sketchMin = statistics.getSketchMin(); // no range given: the current one is kept
+        m_sketchMax = statistics.getSketchMax();
+    }
+    else
+    {
+        m_sketchMin = m_sketchMax = 0.;
+    }
+
+    if (statistics.isEnabled())
+    {
+        m_data.setStatisticsEnabled(true, m_sketchMin, m_sketchMax, m_sketchBins);
+    }
+}
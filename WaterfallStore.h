@@ -0,0 +1,158 @@
+#ifndef WATERFALLSTORE_H
+#define WATERFALLSTORE_H
+
+#include <QImage>
+#include <QObject>
+#include <QRectF>
+#include <QSize>
+
+#include <qwt_raster_data.h>
+
+#include <memory>
+#include <vector>
+
+#include "ColorMaps.h"
+#include "WaterfallData.h"
+#include "WaterfallSession.h"
+
+/* Waterfall data shared by several Waterfallplot views (e.g. an overview, a
+ * zoomed band and a second monitor, see Waterfallplot::shareData()), it lives
+ * as long as one of them uses it. Layers are ingested once, through any view,
+ * then every attached view is notified to refresh its curves and axes.
+ * The rasters rendered by the views are kept until the data changes: a view
+ * whose viewport, range and color map match a previous render reuses its
+ * image instead of rasterizing the data again. */
+class WaterfallStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    // what makes two rasters of the same data identical
+    struct RenderKey
+    {
+        QRectF area;
+        QSize  size;
+        double xMap[4];      // s1, s2, p1, p2
+        double yMap[4];
+        bool   xTransformed; // e.g. logarithmic X axis
+        double zMin;
+        double zMax;
+        const ColorMaps::ColorMap* preset; // baked color map, else colors
+        ColorMaps::ControlPoints colors;
+        bool   colorRing;    // rendered from the color ring (pixel centers, renderer's LUT)
+
+        bool operator==(const RenderKey& other) const;
+    };
+
+    WaterfallStore(double dXMin, double dXMax, // X bounds
+                   const size_t historyExtent,
+                   const size_t layerPoints);
+
+    /* Data restored from a session file: the mapping is its storage (no copy)
+     * until it grows beyond the dimensions of the file (see WaterfallData::resize()). */
+    explicit WaterfallStore(std::unique_ptr<WaterfallSessionFile> session);
+
+    WaterfallData<double>& data() { return m_data; }
+    const WaterfallData<double>& data() const { return m_data; }
+
+    // to be called by the view that changed the data, the render cache is dropped
+    void notifyLayerAdded(); // a layer was added to the history
+    void notifyReset();      // dimensions, bins or history changed
+    void requestReplot(const bool forceRepaint) { emit replotRequested(forceRepaint); }
+
+    // incremented on every data change (views caching rasterized data compare it)
+    quint64 generation() const { return m_generation; }
+
+    bool findRender(const RenderKey& key, QImage& image) const;
+    void storeRender(const RenderKey& key, const QImage& image);
+
+    /* Statistics of the shared data: the noise floor sketch range belongs to the
+     * store, not to the views, so changing a view's range never rebuilds it.
+     * Until a sketch range is set (sketchMin >= sketchMax), the range given when
+     * the statistics are enabled is kept. Both rebuild the sketch from the history. */
+    void setStatisticsEnabled(const bool enabled, const double dLower, const double dUpper);
+    void setStatisticsSketch(const double sketchMin, const double sketchMax, const size_t sketchBins);
+
+signals:
+    void layerAdded();
+    void reset();
+    void replotRequested(const bool forceRepaint);
+
+protected:
+    struct RenderEntry
+    {
+        RenderKey key;
+        QImage    image;
+    };
+
+    std::unique_ptr<WaterfallSessionFile> m_session; // restored data storage (before m_data)
+    WaterfallData<double>    m_data;
+    std::vector<RenderEntry> m_renders; // most recent last
+    quint64                  m_generation = 0;
+    static const size_t      s_maxRenders = 4;
+
+    double m_sketchMin = 0.; // sketchMin >= sketchMax: not set yet
+    double m_sketchMax = 0.;
+    size_t m_sketchBins = 64;
+
+private:
+    Q_DISABLE_COPY(WaterfallStore)
+};
+
+/* Raster data of a view attached to a store (the spectrogram owns and
+ * deletes its raster data, so every view has its own): the values and the
+ * X/Y intervals come from the shared data, the range (Z interval) is the
+ * view's own one. */
+class WaterfallRasterView : public QwtRasterData
+{
+public:
+    explicit WaterfallRasterView(const std::shared_ptr<WaterfallStore>& store) :
+        m_store(store),
+        m_data(&store->data())
+    {
+        syncIntervals();
+        setInterval(Qt::ZAxis, m_data->interval(Qt::ZAxis));
+    }
+
+    const std::shared_ptr<WaterfallStore>& store() const { return m_store; }
+
+    // X and Y follow the data (bounds, offset)
+    void syncIntervals()
+    {
+        setInterval(Qt::XAxis, m_data->interval(Qt::XAxis));
+        setInterval(Qt::YAxis, m_data->interval(Qt::YAxis));
+    }
+
+    // qualified calls: no virtual dispatch per pixel
+    double value(double x, double y) const override
+    {
+        return m_data->WaterfallData<double>::value(x, y);
+    }
+
+    void setRasterXMap(const QwtScaleMap& xMap)
+    {
+        m_data->setRasterXMap(xMap);
+    }
+
+    void initRaster(const QRectF& area, const QSize& raster) override
+    {
+        syncIntervals();
+        m_data->WaterfallData<double>::initRaster(area, raster);
+    }
+
+    void discardRaster() override
+    {
+        m_data->WaterfallData<double>::discardRaster();
+    }
+
+    QRectF pixelHint(const QRectF& area) const override
+    {
+        return m_data->WaterfallData<double>::pixelHint(area);
+    }
+
+protected:
+    const std::shared_ptr<WaterfallStore> m_store;
+    WaterfallData<double>* const          m_data;
+};
+
+#endif // WATERFALLSTORE_H
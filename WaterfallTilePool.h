@@ -0,0 +1,222 @@
+#ifndef WATERFALLTILEPOOL_H
+#define WATERFALLTILEPOOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "WaterfallParallel.h"
+
+/* Persistent work-stealing pool for fine grained jobs (e.g. the tiles of a
+ * raster): the threads are created once and reused by every run.
+ * A run splits the indices in contiguous shares, one per thread (the calling
+ * thread included), and a thread that finished its share steals half of the
+ * remaining indices of another one, so uneven tiles (NaN areas, interpolated
+ * or zoomed regions) don't leave cores idle.
+ * Runs are serialized, a run from inside a job is executed serially.
+ */
+class WaterfallTilePool
+{
+public:
+    // shared pool, grown on demand up to the largest thread count requested
+    static WaterfallTilePool& instance()
+    {
+        static WaterfallTilePool pool;
+        return pool;
+    }
+
+    WaterfallTilePool() = default;
+
+    ~WaterfallTilePool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (std::thread& worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    // threads created so far, the calling thread included
+    size_t threadCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_workers.size() + 1;
+    }
+
+    /* Calls fn(index) for every index of [0, count) using up to maxThreads
+     * threads (0: WaterfallParallel::threadCount()), blocks until done. */
+    template <class Fn>
+    void run(const size_t count, Fn fn, const size_t maxThreads = 0)
+    {
+        const size_t threads = std::min((maxThreads > 0) ? maxThreads : WaterfallParallel::threadCount(), count);
+        if (threads <= 1 || inWorker())
+        {
+            for (size_t index = 0; index < count; ++index)
+            {
+                fn(index);
+            }
+            return;
+        }
+        execute(count, threads, std::function<void(size_t)>(std::ref(fn)));
+    }
+
+protected:
+    // share of the indices of a thread, the owner pops at the front, thieves take the back
+    struct Slot
+    {
+        std::mutex mutex;
+        size_t     begin = 0;
+        size_t     end = 0;
+        char       padding[64]; // no false sharing between the slots
+    };
+
+    static bool& inWorker()
+    {
+        static thread_local bool worker = false;
+        return worker;
+    }
+
+    void execute(const size_t count, const size_t threads, const std::function<void(size_t)>& job)
+    {
+        std::lock_guard<std::mutex> runLock(m_runMutex);
+
+        // the workers are idle between runs: the slots can be (re)allocated
+        while (m_slots.size() < threads)
+        {
+            m_slots.emplace_back(new Slot);
+        }
+        while (m_workers.size() + 1 < threads)
+        {
+            const size_t self = m_workers.size() + 1;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_workers.emplace_back([this, self]() { workerLoop(self); });
+        }
+
+        for (size_t i = 0; i < threads; ++i)
+        {
+            m_slots[i]->begin = count * i / threads;
+            m_slots[i]->end = count * (i + 1) / threads;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_job = &job;
+            m_participants = threads;
+            m_busy = threads - 1;
+            ++m_generation;
+        }
+        m_wake.notify_all();
+
+        inWorker() = true;
+        work(0);
+        inWorker() = false;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]() { return m_busy == 0; });
+        m_job = nullptr;
+    }
+
+    void workerLoop(const size_t self)
+    {
+        inWorker() = true;
+        size_t seen = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            m_wake.wait(lock, [this, seen]() { return m_stop || m_generation != seen; });
+            if (m_stop)
+            {
+                return;
+            }
+            seen = m_generation;
+            if (self >= m_participants)
+            {
+                continue;
+            }
+
+            lock.unlock();
+            work(self);
+            lock.lock();
+            if (--m_busy == 0)
+            {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    void work(const size_t self)
+    {
+        size_t index;
+        while (pop(self, index) || steal(self, index))
+        {
+            (*m_job)(index);
+        }
+    }
+
+    bool pop(const size_t self, size_t& index)
+    {
+        Slot& slot = *m_slots[self];
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        if (slot.begin >= slot.end)
+        {
+            return false;
+        }
+        index = slot.begin++;
+        return true;
+    }
+
+    // takes the back half of another share, its first index is returned, the rest becomes ours
+    bool steal(const size_t self, size_t& index)
+    {
+        for (size_t k = 1; k < m_participants; ++k)
+        {
+            Slot& victim = *m_slots[(self + k) % m_participants];
+            size_t begin;
+            size_t end;
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (victim.begin >= victim.end)
+                {
+                    continue;
+                }
+                end = victim.end;
+                begin = end - (end - victim.begin + 1) / 2;
+                victim.end = begin;
+            }
+
+            Slot& slot = *m_slots[self];
+            std::lock_guard<std::mutex> lock(slot.mutex);
+            slot.begin = begin + 1;
+            slot.end = end;
+            index = begin;
+            return true;
+        }
+        return false;
+    }
+
+    std::mutex                          m_runMutex; // one run at a time
+    mutable std::mutex                  m_mutex;
+    std::condition_variable             m_wake;
+    std::condition_variable             m_done;
+    std::vector<std::thread>            m_workers;
+    std::vector<std::unique_ptr<Slot>>  m_slots;
+    const std::function<void(size_t)>*  m_job = nullptr;
+    size_t                              m_participants = 0;
+    size_t                              m_busy = 0;        // workers still in the current run
+    size_t                              m_generation = 0;  // runs started
+    bool                                m_stop = false;
+
+private:
+    WaterfallTilePool(const WaterfallTilePool&) = delete;
+    WaterfallTilePool& operator=(const WaterfallTilePool&) = delete;
+};
+
+#endif // WATERFALLTILEPOOL_H
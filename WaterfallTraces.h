@@ -0,0 +1,136 @@
+#ifndef WATERFALLTRACES_H
+#define WATERFALLTRACES_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "WaterfallKernels.h"
+
+/* Max-hold, average and min-hold traces of the waterfall layers.
+ * They are maintained incrementally when a layer is added, either since the
+ * last reset (window = 0) or over a sliding window of the last K layers.
+ * The traces are stored as doubles so they can be handed to QwtPlotCurve
+ * without any copy (setRawSamples).
+ */
+template <class T>
+class WaterfallTraces
+{
+public:
+    void setEnabled(const bool enabled)
+    {
+        m_enabled = enabled;
+        reset();
+    }
+    bool isEnabled() const { return m_enabled; }
+
+    // number of layers in the sliding window, 0: every layer since the last reset
+    void setWindow(const size_t layers)
+    {
+        m_window = layers;
+        reset();
+    }
+    size_t getWindow() const { return m_window; }
+
+    void reset()
+    {
+        m_count = 0;
+        std::fill(m_max.begin(), m_max.end(), 0.);
+        std::fill(m_min.begin(), m_min.end(), 0.);
+        std::fill(m_sum.begin(), m_sum.end(), 0.);
+        std::fill(m_avg.begin(), m_avg.end(), 0.);
+    }
+
+    /* Must be called BEFORE layer is stored in the history.
+     * historyLength: filled layers count in the history (without layer)
+     * rows(r):       layer at history row r, rows(maxHistoryLength - 1) is the newest one */
+    template <class RowAccessor>
+    void update(const T* const layer, const size_t length,
+                const size_t historyLength,
+                RowAccessor rows,
+                const size_t maxHistoryLength)
+    {
+        if (m_max.size() != length)
+        {
+            m_max.resize(length);
+            m_min.resize(length);
+            m_sum.resize(length);
+            m_avg.resize(length);
+            reset();
+        }
+
+        if (m_count == 0)
+        {
+            WaterfallKernels::copy(m_max.data(), layer, length);
+            WaterfallKernels::copy(m_min.data(), layer, length);
+            WaterfallKernels::copy(m_sum.data(), layer, length);
+            WaterfallKernels::copy(m_avg.data(), layer, length);
+            m_count = 1;
+            return;
+        }
+
+        const size_t window = (m_window > 0) ? std::min(m_window, maxHistoryLength) : 0;
+
+        WaterfallKernels::max(m_max.data(), layer, length);
+        WaterfallKernels::min(m_min.data(), layer, length);
+        WaterfallKernels::add(m_sum.data(), layer, length);
+
+        // the layer leaving the sliding window
+        if (window > 0 && m_count >= window && historyLength >= window)
+        {
+            const T* const leaving = rows(maxHistoryLength - window);
+            WaterfallKernels::subtract(m_sum.data(), leaving, length);
+
+            // the extrema only need a rescan of the window when the leaving
+            // layer was holding them, which is rare for noisy signals
+            for (size_t i = 0; i < length; ++i)
+            {
+                const double v = double(leaving[i]);
+                const double newValue = double(layer[i]);
+                if (v >= m_max[i] && newValue < v)
+                {
+                    double m = newValue;
+                    for (size_t row = maxHistoryLength - window + 1; row < maxHistoryLength; ++row)
+                    {
+                        m = std::max(m, double(rows(row)[i]));
+                    }
+                    m_max[i] = m;
+                }
+                if (v <= m_min[i] && newValue > v)
+                {
+                    double m = newValue;
+                    for (size_t row = maxHistoryLength - window + 1; row < maxHistoryLength; ++row)
+                    {
+                        m = std::min(m, double(rows(row)[i]));
+                    }
+                    m_min[i] = m;
+                }
+            }
+        }
+        else
+        {
+            ++m_count;
+        }
+
+        WaterfallKernels::scale(m_avg.data(), m_sum.data(), length, 1. / m_count);
+    }
+
+    const double* maxHold() const { return m_max.data(); }
+    const double* average() const { return m_avg.data(); }
+    const double* minHold() const { return m_min.data(); }
+
+    size_t size() const { return m_max.size(); }
+    size_t count() const { return m_count; } // layers in the traces
+
+protected:
+    bool   m_enabled = false;
+    size_t m_window = 0;
+    size_t m_count = 0;
+
+    std::vector<double> m_max;
+    std::vector<double> m_min;
+    std::vector<double> m_sum;
+    std::vector<double> m_avg;
+};
+
+#endif // WATERFALLTRACES_H
@@ -5,6 +5,7 @@
 #include <QDateTime>
 #include <QGridLayout>
 #include <QSizePolicy>
+#include <QTimer>
 #include <QVBoxLayout>
 
 // Qwt includes
@@ -20,27 +21,22 @@
 #include <qwt_scale_engine.h>
 #include <qwt_scale_widget.h>
 #include <qwt_plot_spectrogram.h>
+#include <qwt_plot_textlabel.h>
 #include <qwt_plot_zoomer.h>
+#include <qwt_symbol.h>
 
 // C++ STL and its standard lib includes
 #include <algorithm>
+#include <cmath>
+
+#include "WaterfallIndexImage.h"
 
 namespace
 {
 
 QwtColorMap* controlPointsToQwtColorMap(const ColorMaps::ControlPoints& ctrlPts)
 {
-    using namespace ColorMaps;
-
-    if (ctrlPts.size() < 2 ||
-        std::get<0>(ctrlPts.front()) != 0. ||
-        std::get<0>(ctrlPts.back())  != 1. ||
-        !std::is_sorted(ctrlPts.cbegin(), ctrlPts.cend(),
-        [](const ControlPoint& x, const ControlPoint& y)
-        {
-            // strict weak ordering
-            return std::get<0>(x) < std::get<0>(y);
-        }))
+    if (!ColorMaps::isValid(ctrlPts))
     {
         return nullptr;
     }
@@ -61,6 +57,50 @@ QwtColorMap* controlPointsToQwtColorMap(const ColorMaps::ControlPoints& ctrlPts)
     return lcm;
 }
 
+/* Color map reading a baked lookup table (see ColorMaps::ColorMap): switching
+ * presets only swaps the table's pointer. */
+class LutColorMap: public QwtColorMap
+{
+    const ColorMaps::ColorMap* m_colorMap;
+
+public:
+    explicit LutColorMap(const ColorMaps::ColorMap& colorMap) :
+        QwtColorMap(QwtColorMap::RGB),
+        m_colorMap(&colorMap)
+    {
+    }
+
+    void setColorMap(const ColorMaps::ColorMap& colorMap) { m_colorMap = &colorMap; }
+
+    virtual QRgb rgb(const QwtInterval& interval, double value) const
+    {
+        if (qIsNaN(value) || !interval.isValid())
+        {
+            return 0u;
+        }
+        return m_colorMap->lut->rgb[index(interval, value, ColorMaps::LutSize)];
+    }
+
+    virtual unsigned char colorIndex(const QwtInterval& interval, double value) const
+    {
+        if (qIsNaN(value) || !interval.isValid())
+        {
+            return 0;
+        }
+        return static_cast<unsigned char>(index(interval, value, 256));
+    }
+
+private:
+    static size_t index(const QwtInterval& interval, const double value, const size_t size)
+    {
+        const double width = interval.width();
+        double ratio = (width > 0.) ? (value - interval.minValue()) / width : 0.;
+        ratio = (ratio > 0.) ? ratio : 0.;
+        ratio = (ratio < 1.) ? ratio : 1.;
+        return size_t(ratio * (size - 1));
+    }
+};
+
 class MyZoomer: public QwtPlotZoomer
 {
     QwtPlotSpectrogram* m_spectro;
@@ -116,6 +156,145 @@ public:
     }
 };
 
+/* Rasters are looked up in the render cache of the store first (another
+ * view may have rendered the same viewport), the rasterization is timed
+ * (see WaterfallProfiler).
+ * The data is rasterized into an index image (see WaterfallIndexImage) kept
+ * until the data or the viewport changes, so a range or color map change only
+ * remaps the cached indices to colors. */
+class WaterfallSpectrogram: public QwtPlotSpectrogram
+{
+    WaterfallProfiler& m_profiler;
+    const WaterfallColorRing& m_colorRing;
+    const ColorMaps::ColorMap* m_preset = nullptr;
+    ColorMaps::ControlPoints m_colors;
+
+    mutable WaterfallIndexImage     m_indices;
+    mutable WaterfallStore::RenderKey m_indicesKey;  // without range nor colors
+    mutable const WaterfallStore*   m_indicesStore = nullptr;
+    mutable quint64                 m_indicesGeneration = 0;
+
+    std::function<void()> m_painted;
+
+public:
+    WaterfallSpectrogram(WaterfallProfiler& profiler, const WaterfallColorRing& colorRing) :
+        m_profiler(profiler),
+        m_colorRing(colorRing)
+    {
+    }
+
+    void setColors(const ColorMaps::ControlPoints& colors) { m_preset = nullptr; m_colors = colors; }
+    void setColors(const ColorMaps::ColorMap& preset) { m_preset = &preset; }
+
+    size_t getMemoryUsage() const { return m_indices.getMemoryUsage(); }
+
+    void setTileSize(const int size) { m_indices.setTileSize(size); }
+    int getTileSize() const { return m_indices.getTileSize(); }
+
+    void setPaintedCallback(const std::function<void()>& painted) { m_painted = painted; }
+
+    void draw(QPainter* painter, const QwtScaleMap& xMap, const QwtScaleMap& yMap,
+              const QRectF& canvasRect) const override
+    {
+        QwtPlotSpectrogram::draw(painter, xMap, yMap, canvasRect);
+        if (m_painted)
+        {
+            m_painted();
+        }
+    }
+
+protected:
+    QImage renderImage(const QwtScaleMap& xMap, const QwtScaleMap& yMap,
+                       const QRectF& area, const QSize& imageSize) const override
+    {
+        const WaterfallRasterView* const view = static_cast<const WaterfallRasterView*>(data());
+        if (!view)
+        {
+            return QwtPlotSpectrogram::renderImage(xMap, yMap, area, imageSize);
+        }
+
+        WaterfallStore::RenderKey key;
+        key.area = area;
+        key.size = imageSize;
+        key.xMap[0] = xMap.s1(); key.xMap[1] = xMap.s2(); key.xMap[2] = xMap.p1(); key.xMap[3] = xMap.p2();
+        key.yMap[0] = yMap.s1(); key.yMap[1] = yMap.s2(); key.yMap[2] = yMap.p1(); key.yMap[3] = yMap.p2();
+        key.xTransformed = (xMap.transformation() != nullptr);
+        key.zMin = view->interval(Qt::ZAxis).minValue();
+        key.zMax = view->interval(Qt::ZAxis).maxValue();
+        key.preset = m_preset;
+        if (!m_preset)
+        {
+            key.colors = m_colors;
+        }
+        // the ring doesn't sample the pixels like the other paths: its renders aren't theirs
+        key.colorRing = m_colorRing.isEnabled() && !xMap.transformation();
+
+        QImage image;
+        if (view->store()->findRender(key, image))
+        {
+            return image;
+        }
+
+        // the X map gives the bins of the pixels (non-uniform bins, logarithmic X axis)
+        const_cast<WaterfallRasterView*>(view)->setRasterXMap(xMap);
+
+        {
+            WATERFALL_PROFILE_SCOPE(m_profiler, WaterfallProfiler::Render);
+            if (key.colorRing)
+            {
+                // rows colorized at ingest: only a gather of their pixels
+                image = m_colorRing.render(view->store()->data(), area, imageSize);
+            }
+            else if (colorMap() && colorMap()->format() == QwtColorMap::RGB &&
+                     view->interval(Qt::ZAxis).isValid())
+            {
+                image = renderIndices(*view, key, xMap, yMap, area, imageSize);
+            }
+            else
+            {
+                image = QwtPlotSpectrogram::renderImage(xMap, yMap, area, imageSize);
+            }
+        }
+        view->store()->storeRender(key, image);
+        return image;
+    }
+
+    QImage renderIndices(const WaterfallRasterView& view, const WaterfallStore::RenderKey& key,
+                         const QwtScaleMap& xMap, const QwtScaleMap& yMap,
+                         const QRectF& area, const QSize& imageSize) const
+    {
+        WaterfallStore::RenderKey indicesKey = key;
+        indicesKey.zMin = indicesKey.zMax = 0.;
+        indicesKey.preset = nullptr;
+        indicesKey.colors.clear();
+
+        const WaterfallStore* const store = view.store().get();
+        if (m_indices.isNull() || m_indicesStore != store ||
+            m_indicesGeneration != store->generation() || !(m_indicesKey == indicesKey))
+        {
+            // the same sampling as QwtPlotSpectrogram::renderTile()
+            WaterfallRasterView& raster = const_cast<WaterfallRasterView&>(view);
+            raster.initRaster(area, imageSize);
+            m_indices.rasterize(imageSize.width(), imageSize.height(), [&](const int x, const int y)
+            {
+                return raster.value(xMap.invTransform(x), yMap.invTransform(y));
+            }, size_t(renderThreadCount()));
+            raster.discardRaster();
+
+            m_indicesKey = indicesKey;
+            m_indicesStore = store;
+            m_indicesGeneration = store->generation();
+        }
+
+        const QwtInterval range = view.interval(Qt::ZAxis);
+        const QwtColorMap* const colors = colorMap();
+        return m_indices.remap(range.minValue(), range.maxValue(), [&](const double value)
+        {
+            return colors->rgb(range, value);
+        }, size_t(renderThreadCount()));
+    }
+};
+
 class WaterfallTimeScaleDraw: public QwtScaleDraw
 {
     const Waterfallplot& m_waterfallPlot;
@@ -154,7 +333,7 @@ Waterfallplot::Waterfallplot(QWidget* parent, const ColorMaps::ControlPoints& ct
     m_picker(new QwtPlotPicker(QwtPlot::xBottom, QwtPlot::yLeft,
         QwtPlotPicker::CrossRubberBand, QwtPicker::AlwaysOn, m_plotSpectrogram->canvas())),
     m_panner(new QwtPlotPanner(m_plotSpectrogram->canvas())),
-    m_spectrogram(new QwtPlotSpectrogram),
+    m_spectrogram(new WaterfallSpectrogram(m_profiler, m_colorRing)),
     m_zoomer(new MyZoomer(m_plotSpectrogram->canvas(), m_spectrogram, *this)),
     m_horCurveMarker(new QwtPlotMarker),
     m_vertCurveMarker(new QwtPlotMarker),
@@ -299,7 +478,17 @@ Waterfallplot::Waterfallplot(QWidget* parent, const ColorMaps::ControlPoints& ct
     connect(m_picker, static_cast<void(QwtPlotPicker::*)(const QPointF&)>(&QwtPlotPicker::selected),
             this, &Waterfallplot::selectedPoint);
     connect(m_picker, static_cast<void(QwtPlotPicker::*)(const QPointF&)>(&QwtPlotPicker::moved),
-            this, &Waterfallplot::selectedPoint);
+            this, &Waterfallplot::movedPoint);
+
+    // at most one curves update per frame while dragging
+    m_pickTimer = new QTimer(this);
+    m_pickTimer->setSingleShot(true);
+    m_pickTimer->setInterval(16);
+    connect(m_pickTimer, &QTimer::timeout, this, &Waterfallplot::requestPickedCurves);
+    connect(&m_curveExtractor, &WaterfallCurveExtractor::extracted, this, &Waterfallplot::applyPickedCurves);
+
+    m_autosaveTimer = new QTimer(this);
+    connect(m_autosaveTimer, &QTimer::timeout, this, &Waterfallplot::autosave);
 
     m_panner->setMouseButton(Qt::MidButton);
 
@@ -366,17 +555,21 @@ void Waterfallplot::autoRescale(const QRectF& rect)
     }
 }
 
-void Waterfallplot::setDataDimensions(double dXMin, double dXMax,
+bool Waterfallplot::setDataDimensions(double dXMin, double dXMax,
                                       const size_t historyExtent,
                                       const size_t layerPoints)
 {
-    // NB: m_data is just for convenience !
-    m_data = new WaterfallData<double>(dXMin, dXMax, historyExtent, layerPoints);
-    m_spectrogram->setData(m_data); // NB: owner of the data is m_spectrogram !
+    if (m_data)
+    {
+        return resizeData(dXMin, dXMax, historyExtent, layerPoints);
+    }
+    if (historyExtent == 0 || layerPoints == 0)
+    {
+        return false;
+    }
 
-    setupCurves();
-    freeCurvesData();
-    allocateCurvesData();
+    attachStore(std::make_shared<WaterfallStore>(dXMin, dXMax, historyExtent, layerPoints));
+    setupData();
 
     // After changing data dimensions, we need to reset curves markers
     // to show the last received data on  the horizontal axis and the history
@@ -390,6 +583,255 @@ void Waterfallplot::setDataDimensions(double dXMin, double dXMax,
     // scale x
     m_plotHorCurve->setAxisScale(QwtPlot::xBottom, dXMin, dXMax);
     m_plotSpectrogram->setAxisScale(QwtPlot::xBottom, dXMin, dXMax);
+    return true;
+}
+
+// settings of this view applied to new data
+void Waterfallplot::setupData()
+{
+    m_accumulator.reset();
+
+    m_data->setRebinMode(m_rebinMode);
+    m_data->traces().setWindow(m_tracesWindow);
+    m_data->traces().setEnabled(m_showMaxHold || m_showAverage || m_showMinHold);
+
+    m_store->setStatisticsSketch(m_sketchMin, m_sketchMax, m_sketchBins);
+    if (m_statisticsEnabled)
+    {
+        double dLower;
+        double dUpper;
+        getRange(dLower, dUpper);
+        m_store->setStatisticsEnabled(true, dLower, dUpper);
+    }
+    applyDetectorSettings();
+
+    setupCurves();
+    allocateCurvesData();
+}
+
+bool Waterfallplot::resizeData(double dXMin, double dXMax,
+                               const size_t historyExtent,
+                               const size_t layerPoints)
+{
+    if (!m_data->resize(dXMin, dXMax, historyExtent, layerPoints))
+    {
+        return false;
+    }
+    m_accumulator.reset();
+
+    m_store->notifyReset(); // -> dataReset() of every view
+    return true;
+}
+
+bool Waterfallplot::shareData(const Waterfallplot& other)
+{
+    if (!other.m_store || other.m_store == m_store)
+    {
+        return false;
+    }
+
+    // the previous data may be released
+    m_curveExtractor.cancel();
+    m_curveExtractor.wait();
+
+    double dLower;
+    double dUpper;
+    getRange(dLower, dUpper);
+    const bool hadData = (m_rasterView != nullptr);
+
+    attachStore(other.m_store);
+    m_accumulator.reset();
+
+    // data settings follow the shared data
+    m_rebinMode = other.m_rebinMode;
+    m_tracesWindow = other.m_tracesWindow;
+    m_statisticsEnabled = other.m_statisticsEnabled;
+    m_sketchMin = other.m_sketchMin;
+    m_sketchMax = other.m_sketchMax;
+    m_sketchBins = other.m_sketchBins;
+    m_detectorEnabled = other.m_detectorEnabled;
+    m_detectorUseThreshold = other.m_detectorUseThreshold;
+    m_detectorThreshold = other.m_detectorThreshold;
+    m_detectorUseNoiseFloor = other.m_detectorUseNoiseFloor;
+    m_detectorMargin = other.m_detectorMargin;
+
+    if (hadData)
+    {
+        setRange(dLower, dUpper); // the range stays the view's one
+    }
+    else
+    {
+        other.getRange(dLower, dUpper);
+        setRange(dLower, dUpper);
+    }
+
+    setupCurves();
+    dataReset();
+
+    return true;
+}
+
+bool Waterfallplot::saveSession(const QString& fileName, QString* const error /*= nullptr*/)
+{
+    QString message;
+    if (!m_data)
+    {
+        message = "No data to save.";
+    }
+    else
+    {
+        m_sessionWriter.wait(); // an autosave may be writing the same file
+        if (WaterfallSessionWriter::write(*m_data, sessionView(), fileName, message))
+        {
+            return true;
+        }
+    }
+
+    if (error)
+    {
+        *error = message;
+    }
+    return false;
+}
+
+bool Waterfallplot::restoreSession(const QString& fileName, QString* const error /*= nullptr*/)
+{
+    QString message;
+    std::unique_ptr<WaterfallSessionFile> session = WaterfallSessionFile::open(fileName, message);
+    if (!session)
+    {
+        if (error)
+        {
+            *error = message;
+        }
+        return false;
+    }
+    const WaterfallSessionView view = session->view();
+
+    // the previous data may be released
+    m_curveExtractor.cancel();
+    m_curveExtractor.wait();
+
+    attachStore(std::make_shared<WaterfallStore>(std::move(session)));
+    setupData();
+
+    if (view.preset)
+    {
+        setColorMap(*view.preset);
+    }
+    else
+    {
+        setColorMap(view.colors);
+    }
+    setRange(view.zMin, view.zMax);
+
+    m_markerX = view.markerX;
+    m_markerY = view.markerY;
+    dataReset(); // markers (kept if they're still valid), axes and curves
+
+    return true;
+}
+
+void Waterfallplot::setAutosave(const QString& fileName, const int msecs)
+{
+    m_autosaveFile = fileName;
+    if (fileName.isEmpty() || msecs <= 0)
+    {
+        m_autosaveTimer->stop();
+        return;
+    }
+    m_autosaveTimer->start(msecs);
+}
+
+void Waterfallplot::autosave()
+{
+    // nothing new since the last save (or it's still running)
+    if (!m_data || m_sessionWriter.isRunning() ||
+        (m_store.get() == m_autosavedStore && m_store->generation() == m_autosavedGeneration))
+    {
+        return;
+    }
+
+    if (m_sessionWriter.start(*m_data, sessionView(), m_autosaveFile))
+    {
+        m_autosavedStore = m_store.get();
+        m_autosavedGeneration = m_store->generation();
+    }
+}
+
+WaterfallSessionView Waterfallplot::sessionView() const
+{
+    WaterfallSessionView view;
+    getRange(view.zMin, view.zMax);
+    view.preset = m_preset;
+    if (!m_preset)
+    {
+        view.colors = m_ctrlPts;
+    }
+    view.markerX = m_markerX;
+    view.markerY = m_markerY;
+    return view;
+}
+
+void Waterfallplot::attachStore(const std::shared_ptr<WaterfallStore>& store)
+{
+    if (m_store)
+    {
+        m_store->disconnect(this);
+    }
+    m_sessionWriter.wait(); // the autosave reads the previous data
+
+    // the range is the view's one, it's kept with the new data
+    const QwtInterval range = (m_rasterView) ? m_rasterView->interval(Qt::ZAxis) : QwtInterval();
+
+    m_store = store;
+    m_data = &m_store->data(); // NB: m_data is just for convenience !
+    m_rasterView = new WaterfallRasterView(m_store);
+    if (range.isValid())
+    {
+        m_rasterView->setInterval(Qt::ZAxis, range);
+    }
+    m_spectrogram->setData(m_rasterView); // NB: owner of the raster view is m_spectrogram !
+
+    connect(m_store.get(), &WaterfallStore::layerAdded, this, &Waterfallplot::layerAdded);
+    connect(m_store.get(), &WaterfallStore::reset, this, &Waterfallplot::dataReset);
+    connect(m_store.get(), &WaterfallStore::replotRequested, this, &Waterfallplot::replotView);
+}
+
+void Waterfallplot::dataReset()
+{
+    m_rasterView->syncIntervals();
+    m_colorRing.reset(*m_data);
+    allocateCurvesData();
+
+    // keep the markers where they are if they are still valid
+    const double dXMin = m_data->getXMin();
+    const double dXMax = m_data->getXMax();
+    const size_t historyExtent = m_data->getMaxHistoryLength();
+    if (m_markerX < dXMin || m_markerX >= dXMax)
+    {
+        m_markerX = (dXMin + dXMax) / 2;
+    }
+    if (m_markerY >= historyExtent)
+    {
+        m_markerY = historyExtent - 1;
+    }
+
+    const double currentOffset = getOffset();
+    m_horCurveMarker->setValue(m_markerX, 0.0);
+    m_vertCurveMarker->setValue(0.0, m_markerY + currentOffset);
+
+    m_plotHorCurve->setAxisScale(QwtPlot::xBottom, dXMin, dXMax);
+    m_plotSpectrogram->setAxisScale(QwtPlot::xBottom, dXMin, dXMax);
+    if (!m_zoomActive)
+    {
+        m_plotSpectrogram->setAxisScale(QwtPlot::yLeft, currentOffset, historyExtent + currentOffset);
+        m_plotVertCurve->setAxisScale(QwtPlot::yLeft, currentOffset, historyExtent + currentOffset);
+    }
+
+    updateCurvesData();
+    m_spectrogram->invalidateCache();
+    markDirty(DirtyAll);
 }
 
 void Waterfallplot::getDataDimensions(double& dXMin,
@@ -399,86 +841,403 @@ void Waterfallplot::getDataDimensions(double& dXMin,
 {
     if (m_data)
     {
-        dXMin = m_data->getXMin();
-        dXMax = m_data->getXMax();
-        historyExtent = m_data->getMaxHistoryLength();
-        layerPoints = m_data->getLayerPoints();
+        dXMin = m_data->getXMin();
+        dXMax = m_data->getXMax();
+        historyExtent = m_data->getMaxHistoryLength();
+        layerPoints = m_data->getLayerPoints();
+    }
+    else
+    {
+        dXMin = 0;
+        dXMax = 0;
+        historyExtent = 0;
+        layerPoints = 0;
+    }
+}
+
+void Waterfallplot::setFrozen(const bool frozen)
+{
+    if (frozen == m_frozen)
+    {
+        return;
+    }
+    m_frozen = frozen;
+
+    if (m_frozen)
+    {
+        m_frozenOffset = getOffset();
+        return;
+    }
+
+    if (!m_data)
+    {
+        return;
+    }
+
+    // jump to live: the layers absorbed while frozen are shown in a single redraw
+    const double currentOffset = getOffset();
+    const size_t maxHistory = m_data->getMaxHistoryLength();
+    const double shift = currentOffset - m_frozenOffset;
+
+    const QwtScaleDiv& yDiv = m_plotSpectrogram->axisScaleDiv(QwtPlot::yLeft);
+    const double yMin = (m_zoomActive) ? yDiv.lowerBound() + shift : currentOffset;
+    const double yMax = (m_zoomActive) ? yDiv.upperBound() + shift : maxHistory + currentOffset;
+    m_plotSpectrogram->setAxisScale(QwtPlot::yLeft, yMin, yMax);
+    m_plotVertCurve->setAxisScale(QwtPlot::yLeft, yMin, yMax);
+
+    static_cast<WaterfallTimeScaleDraw*>(m_plotSpectrogram->axisScaleDraw(QwtPlot::yLeft))->invalidateCache();
+    static_cast<WaterfallTimeScaleDraw*>(m_plotVertCurve->axisScaleDraw(QwtPlot::yLeft))->invalidateCache();
+
+    m_vertCurveMarker->setValue(0.0, m_markerY + currentOffset);
+    updateCurvesData();
+
+    markDirty(DirtyAll);
+    replotView(false); // the other views didn't change
+}
+
+void Waterfallplot::replot(bool forceRepaint /*= false*/)
+{
+    if (m_store)
+    {
+        m_store->requestReplot(forceRepaint); // -> replotView() of every view
+        return;
+    }
+    replotView(forceRepaint);
+}
+
+void Waterfallplot::replotView(const bool forceRepaint)
+{
+    if (m_frozen && m_dirty == DirtyFrozenLayer)
+    {
+        return; // the pinned window doesn't change while data is absorbed
+    }
+
+    if (!m_plotSpectrogram->isVisible())
+    {
+        // temporary solution for older Qwt versions
+        QApplication::postEvent(m_plotHorCurve, new QEvent(QEvent::LayoutRequest));
+        QApplication::postEvent(m_plotVertCurve, new QEvent(QEvent::LayoutRequest));
+        QApplication::postEvent(m_plotSpectrogram, new QEvent(QEvent::LayoutRequest));
+    }
+    
+    updateEventMarkers();
+    updateStatsOverlay();
+
+    if (m_dirty == 0 || (m_dirty & DirtyLayout))
+    {
+        m_dirty = 0;
+        updateLayout();
+
+        if (forceRepaint)
+        {
+            m_plotHorCurve->repaint();
+            m_plotVertCurve->repaint();
+            m_plotSpectrogram->repaint();
+        }
+        return;
+    }
+
+    // only the time axes scroll: their labels width may change
+    WATERFALL_PROFILE_SCOPE(m_profiler, WaterfallProfiler::Layout);
+    alignAxis(QwtPlot::yLeft);
+
+    // the spectrogram first: its scrolled time axis is synced to the vertical curve plot
+    // here, the queued scaleDivChanged() then finds them in sync (no layout per layer)
+    replotCanvas(m_plotSpectrogram, DirtySpectrogram, forceRepaint);
+    const QwtScaleDiv& timeDiv = m_plotSpectrogram->axisScaleDiv(QwtPlot::yLeft);
+    if (!(m_plotVertCurve->axisScaleDiv(QwtPlot::yLeft) == timeDiv))
+    {
+        m_plotVertCurve->setAxisScaleDiv(QwtPlot::yLeft, timeDiv);
+        markDirty(DirtyVertCurve);
+    }
+    replotCanvas(m_plotHorCurve, DirtyHorCurve, forceRepaint);
+    replotCanvas(m_plotVertCurve, DirtyVertCurve, forceRepaint);
+    m_dirty = 0;
+}
+
+void Waterfallplot::replotCanvas(QwtPlot* const plot, const int flag, const bool forceRepaint)
+{
+    // like QwtPlot::replot(), but the canvas is only invalidated when its content changed
+    plot->updateAxes();
+    QApplication::sendPostedEvents(plot, QEvent::LayoutRequest);
+
+    if (m_dirty & flag)
+    {
+        QWidget* const canvas = plot->canvas();
+        QMetaObject::invokeMethod(canvas, "replot", Qt::DirectConnection); // update(contentsRect())
+        if (forceRepaint)
+        {
+            canvas->repaint(canvas->contentsRect());
+        }
+    }
+}
+
+void Waterfallplot::setWaterfallVisibility(const bool bVisible)
+{
+    // useful ? complete ?
+    m_spectrogram->setVisible(bVisible);
+    markDirty(DirtySpectrogram);
+}
+
+bool Waterfallplot::addData(const double* const dataPtr, const size_t dataLen, const time_t timestamp)
+{
+    WATERFALL_PROFILE_SCOPE(m_profiler, WaterfallProfiler::Ingest);
+
+    if (!m_data)
+    {
+        ++m_droppedFrames;
+        return false;
+    }
+
+    // layers of another length are resampled (if enabled) before being integrated
+    const double* const layer = m_data->rebin(dataPtr, dataLen);
+    if (!layer)
+    {
+        ++m_droppedFrames;
+        return false;
+    }
+    const size_t layerPoints = m_data->getLayerPoints();
+
+    if (m_accumulator.isActive())
+    {
+        if (!m_accumulator.push(layer, layerPoints, timestamp))
+        {
+            return true; // frame integrated, the window isn't complete yet
+        }
+
+        return addLayer(m_accumulator.layer(), m_accumulator.layerLength(), m_accumulator.timestamp());
+    }
+
+    return addLayer(layer, layerPoints, timestamp);
+}
+
+void Waterfallplot::setRebinMode(const WaterfallData<double>::RebinMode mode)
+{
+    m_rebinMode = mode;
+    if (m_data)
+    {
+        m_data->setRebinMode(m_rebinMode);
+    }
+}
+
+void Waterfallplot::setIntegration(const WaterfallAccumulator<double>::Mode mode,
+                                   const size_t frames,
+                                   const int msecs /*= 0*/,
+                                   const double alpha /*= 0.1*/)
+{
+    m_accumulator.setup(mode, frames, msecs, alpha);
+}
+
+void Waterfallplot::setTracesVisible(const bool maxHold, const bool average, const bool minHold)
+{
+    m_showMaxHold = maxHold;
+    m_showAverage = average;
+    m_showMinHold = minHold;
+
+    const bool enabled = m_showMaxHold || m_showAverage || m_showMinHold;
+    if (m_data && m_data->traces().isEnabled() != enabled)
+    {
+        m_data->traces().setEnabled(enabled);
+    }
+
+    if (m_maxHoldCurve)
+    {
+        m_maxHoldCurve->setVisible(m_showMaxHold);
+        m_averageCurve->setVisible(m_showAverage);
+        m_minHoldCurve->setVisible(m_showMinHold);
+    }
+    markDirty(DirtyHorCurve);
+}
+
+void Waterfallplot::setTracesWindow(const size_t layers)
+{
+    m_tracesWindow = layers;
+    if (m_data)
+    {
+        m_data->traces().setWindow(m_tracesWindow);
+    }
+}
+
+void Waterfallplot::setStatisticsEnabled(const bool enabled)
+{
+    m_statisticsEnabled = enabled;
+    if (m_store)
+    {
+        double dLower;
+        double dUpper;
+        getRange(dLower, dUpper); // only used if the store has no sketch range yet
+        m_store->setStatisticsEnabled(enabled, dLower, dUpper);
+        updateCurvesData();
+    }
+}
+
+void Waterfallplot::setStatisticsSketch(const double sketchMin, const double sketchMax,
+                                        const size_t sketchBins /*= 64*/)
+{
+    m_sketchMin = sketchMin;
+    m_sketchMax = sketchMax;
+    m_sketchBins = sketchBins;
+    if (m_store)
+    {
+        m_store->setStatisticsSketch(m_sketchMin, m_sketchMax, m_sketchBins);
+        updateCurvesData();
+    }
+}
+
+void Waterfallplot::setStatisticsCurvesVisible(const bool mean, const bool noiseFloor)
+{
+    m_showMean = mean;
+    m_showNoiseFloor = noiseFloor;
+
+    if (m_meanCurve)
+    {
+        m_meanCurve->setVisible(m_showMean);
+        m_noiseFloorCurve->setVisible(m_showNoiseFloor);
+    }
+    if (m_data)
+    {
+        updateCurvesData(); // the curves are set from the current buffers
+    }
+    markDirty(DirtyHorCurve);
+}
+
+const WaterfallStatistics<double>* Waterfallplot::statistics() const
+{
+    return (m_data && m_data->statistics().isEnabled()) ? &m_data->statistics() : nullptr;
+}
+
+void Waterfallplot::setDetectorEnabled(const bool enabled)
+{
+    m_detectorEnabled = enabled;
+    applyDetectorSettings();
+}
+
+void Waterfallplot::setDetectorThreshold(const bool enabled, const double threshold)
+{
+    m_detectorUseThreshold = enabled;
+    m_detectorThreshold = threshold;
+    applyDetectorSettings();
+}
+
+void Waterfallplot::setDetectorNoiseFloorMargin(const bool enabled, const double margin)
+{
+    m_detectorUseNoiseFloor = enabled;
+    m_detectorMargin = margin;
+    applyDetectorSettings();
+}
+
+const WaterfallDetector<double>* Waterfallplot::detector() const
+{
+    return (m_data && m_data->detector().isEnabled()) ? &m_data->detector() : nullptr;
+}
+
+void Waterfallplot::applyDetectorSettings()
+{
+    if (!m_data)
+    {
+        return;
     }
-    else
+
+    WaterfallDetector<double>& detector = m_data->detector();
+    detector.setEnabled(m_detectorEnabled);
+    detector.setThreshold(m_detectorUseThreshold, m_detectorThreshold);
+    detector.setNoiseFloorMargin(m_detectorUseNoiseFloor, m_detectorMargin);
+    if (!m_detectorEnabled)
     {
-        dXMin = 0;
-        dXMax = 0;
-        historyExtent = 0;
-        layerPoints = 0;
+        detector.clear();
     }
+    markDirty(DirtySpectrogram); // events markers
 }
 
-void Waterfallplot::replot(bool forceRepaint /*= false*/)
+bool Waterfallplot::setBinEdges(const std::vector<double>& edges)
 {
-    if (!m_plotSpectrogram->isVisible())
+    if (!m_data || !m_data->setBinEdges(edges))
     {
-        // temporary solution for older Qwt versions
-        QApplication::postEvent(m_plotHorCurve, new QEvent(QEvent::LayoutRequest));
-        QApplication::postEvent(m_plotVertCurve, new QEvent(QEvent::LayoutRequest));
-        QApplication::postEvent(m_plotSpectrogram, new QEvent(QEvent::LayoutRequest));
+        return false;
     }
-    
-    updateLayout();
 
-    /*m_plotHorCurve->replot();
-    m_plotVertCurve->replot();
-    m_plotSpectrogram->replot();*/
-    
-    if (forceRepaint)
+    m_store->notifyReset(); // -> dataReset() of every view
+    return true;
+}
+
+void Waterfallplot::setXAxisLogarithmic(const bool logarithmic)
+{
+    for (QwtPlot* plot : { m_plotHorCurve, m_plotSpectrogram })
     {
-        m_plotHorCurve->repaint();
-        m_plotVertCurve->repaint();
-        m_plotSpectrogram->repaint();
+        QwtScaleEngine* const engine = (logarithmic) ? static_cast<QwtScaleEngine*>(new QwtLogScaleEngine)
+                                                     : static_cast<QwtScaleEngine*>(new QwtLinearScaleEngine);
+        engine->setAttribute(QwtScaleEngine::Floating, true);
+        plot->setAxisScaleEngine(QwtPlot::xBottom, engine);
     }
+    m_spectrogram->invalidateCache();
+    markDirty(DirtyAll);
 }
 
-void Waterfallplot::setWaterfallVisibility(const bool bVisible)
+bool Waterfallplot::addLayer(const double* const dataPtr, const size_t dataLen, const time_t timestamp)
 {
-    // useful ? complete ?
-    m_spectrogram->setVisible(bVisible);
+    const bool bRet = m_data->addData(dataPtr, dataLen, timestamp);
+    if (!bRet)
+    {
+        ++m_droppedFrames;
+    }
+    else
+    {
+        // ingest rate over (at least) the last second
+        ++m_rateLayers;
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double>(now - m_rateStart).count();
+        if (elapsed >= 1.)
+        {
+            m_layersPerSecond = m_rateLayers / elapsed;
+            m_rateLayers = 0;
+            m_rateStart = now;
+        }
+
+        m_store->notifyLayerAdded(); // -> layerAdded() of every view
+    }
+    return bRet;
 }
 
-bool Waterfallplot::addData(const double* const dataPtr, const size_t dataLen, const time_t timestamp)
+void Waterfallplot::layerAdded()
 {
-    if (!m_data)
+    m_rasterView->syncIntervals();
+    m_colorRing.addLayer(*m_data); // even while frozen, the ring mirrors the data
+
+    if (m_frozen)
     {
-        return false;
+        // the view stays pinned on absolute layers: nothing to redraw until resumed
+        markDirty(DirtyFrozenLayer);
+        return;
     }
 
-    const bool bRet = m_data->addData(dataPtr, dataLen, timestamp);
-    if (bRet)
-    {
-        updateCurvesData();
+    // scrolled by a layer: the canvases change, the axes only if their ticks moved
+    markDirty(DirtySpectrogram);
+    updateCurvesData();
 
-        // refresh spectrogram content and Y axis labels
-        //m_spectrogram->invalidateCache();
+    // refresh spectrogram content and Y axis labels
+    //m_spectrogram->invalidateCache();
 
-        auto const ySpectroLeftAxis = static_cast<WaterfallTimeScaleDraw*>(
-                    m_plotSpectrogram->axisScaleDraw(QwtPlot::yLeft));
-        ySpectroLeftAxis->invalidateCache();
+    auto const ySpectroLeftAxis = static_cast<WaterfallTimeScaleDraw*>(
+                m_plotSpectrogram->axisScaleDraw(QwtPlot::yLeft));
+    ySpectroLeftAxis->invalidateCache();
 
-        auto const yHistoLeftAxis = static_cast<WaterfallTimeScaleDraw*>(
-                    m_plotVertCurve->axisScaleDraw(QwtPlot::yLeft));
-        yHistoLeftAxis->invalidateCache();
+    auto const yHistoLeftAxis = static_cast<WaterfallTimeScaleDraw*>(
+                m_plotVertCurve->axisScaleDraw(QwtPlot::yLeft));
+    yHistoLeftAxis->invalidateCache();
 
-        const double currentOffset = getOffset();
-        const size_t maxHistory = m_data->getMaxHistoryLength();
+    const double currentOffset = getOffset();
+    const size_t maxHistory = m_data->getMaxHistoryLength();
 
-        const QwtScaleDiv& yDiv = m_plotSpectrogram->axisScaleDiv(QwtPlot::yLeft);
-        const double yMin = (m_zoomActive) ? yDiv.lowerBound() + 1 : currentOffset;
-        const double yMax = (m_zoomActive) ? yDiv.upperBound() + 1 : maxHistory + currentOffset;
+    const QwtScaleDiv& yDiv = m_plotSpectrogram->axisScaleDiv(QwtPlot::yLeft);
+    const double yMin = (m_zoomActive) ? yDiv.lowerBound() + 1 : currentOffset;
+    const double yMax = (m_zoomActive) ? yDiv.upperBound() + 1 : maxHistory + currentOffset;
 
-        m_plotSpectrogram->setAxisScale(QwtPlot::yLeft, yMin, yMax);
-        m_plotVertCurve->setAxisScale(QwtPlot::yLeft, yMin, yMax);
+    m_plotSpectrogram->setAxisScale(QwtPlot::yLeft, yMin, yMax);
+    m_plotVertCurve->setAxisScale(QwtPlot::yLeft, yMin, yMax);
 
-        m_vertCurveMarker->setValue(0.0, m_markerY + currentOffset);
-    }
-    return bRet;
+    m_vertCurveMarker->setValue(0.0, m_markerY + currentOffset);
+
+    updateEventMarkers();
 }
 
 void Waterfallplot::setRange(double dLower, double dUpper)
@@ -504,7 +1263,7 @@ void Waterfallplot::setRange(double dLower, double dUpper)
             }
             else
             {
-                colorMap = controlPointsToQwtColorMap(m_ctrlPts);
+                colorMap = (m_preset) ? new LutColorMap(*m_preset) : controlPointsToQwtColorMap(m_ctrlPts);
                 m_bColorBarInitialized = true;
             }
             axis->setColorMap(QwtInterval(dLower, dUpper), colorMap);
@@ -515,19 +1274,23 @@ void Waterfallplot::setRange(double dLower, double dUpper)
     m_plotHorCurve->setAxisScale(QwtPlot::yLeft, dLower, dUpper);
     m_plotVertCurve->setAxisScale(QwtPlot::xBottom, dLower, dUpper);
 
-    if (m_data)
+    if (m_rasterView)
     {
-        m_data->setRange(dLower, dUpper);
+        m_rasterView->setInterval(Qt::ZAxis, QwtInterval(dLower, dUpper)); // this view's range
     }
+    m_colorRing.setRange(dLower, dUpper, m_data);
 
     m_spectrogram->invalidateCache();
+    markDirty(DirtyAll);
 }
 
 void Waterfallplot::getRange(double& rangeMin, double& rangeMax) const
 {
-    if (m_data)
+    if (m_rasterView)
     {
-        m_data->getRange(rangeMin, rangeMax);
+        const QwtInterval& range = m_rasterView->interval(Qt::ZAxis);
+        rangeMin = range.minValue();
+        rangeMax = range.maxValue();
     }
     else
     {
@@ -551,14 +1314,15 @@ void Waterfallplot::getDataRange(double& rangeMin, double& rangeMax) const
 
 void Waterfallplot::clear()
 {
+    m_accumulator.reset();
+
     if (m_data)
     {
         m_data->clear();
-    }
 
-    setupCurves();
-    freeCurvesData();
-    allocateCurvesData();
+        // curves arrays are kept, they are only refreshed
+        m_store->notifyReset(); // -> dataReset() of every view
+    }
 }
 
 time_t Waterfallplot::getLayerDate(const double y) const
@@ -628,7 +1392,10 @@ bool Waterfallplot::setColorMap(const ColorMaps::ControlPoints& colorMap)
         return false;
     }
     m_ctrlPts = colorMap;
+    m_preset = nullptr;
     m_spectrogram->setColorMap(spectrogramColorMap);
+    static_cast<WaterfallSpectrogram*>(m_spectrogram)->setColors(m_ctrlPts);
+    m_colorRing.setColorMap(m_ctrlPts, m_data);
 
     if (m_plotSpectrogram->axisEnabled(QwtPlot::yRight))
     {
@@ -644,13 +1411,58 @@ bool Waterfallplot::setColorMap(const ColorMaps::ControlPoints& colorMap)
     }
 
     m_spectrogram->invalidateCache();
+    markDirty(DirtySpectrogram);
 
     return true;
 }
 
+void Waterfallplot::setColorMap(const ColorMaps::ColorMap& colorMap)
+{
+    // the color maps are created once, then only their lookup table is swapped
+    LutColorMap* const spectrogramColorMap = dynamic_cast<LutColorMap*>(
+                const_cast<QwtColorMap*>(m_spectrogram->colorMap()));
+    if (spectrogramColorMap)
+    {
+        spectrogramColorMap->setColorMap(colorMap);
+    }
+    else
+    {
+        m_spectrogram->setColorMap(new LutColorMap(colorMap));
+    }
+    m_preset = &colorMap;
+    static_cast<WaterfallSpectrogram*>(m_spectrogram)->setColors(colorMap);
+    m_colorRing.setColorMap(colorMap, m_data);
+
+    if (m_plotSpectrogram->axisEnabled(QwtPlot::yRight))
+    {
+        QwtScaleWidget* axis = m_plotSpectrogram->axisWidget(QwtPlot::yRight);
+        if (axis->isColorBarEnabled())
+        {
+            LutColorMap* const colorBarMap = dynamic_cast<LutColorMap*>(
+                        const_cast<QwtColorMap*>(axis->colorMap()));
+            if (colorBarMap)
+            {
+                colorBarMap->setColorMap(colorMap);
+                axis->update();
+            }
+            else
+            {
+                double dLower;
+                double dUpper;
+                getRange(dLower, dUpper);
+
+                axis->setColorMap(QwtInterval(dLower, dUpper), new LutColorMap(colorMap));
+            }
+        }
+    }
+
+    m_spectrogram->invalidateCache();
+    markDirty(DirtySpectrogram);
+}
+
 ColorMaps::ControlPoints Waterfallplot::getColorMap() const
 {
-    return m_ctrlPts;
+    return (m_preset) ? ColorMaps::toControlPoints(*m_preset) : m_ctrlPts;
 }
 
 void Waterfallplot::scaleDivChanged()
@@ -698,8 +1510,13 @@ void Waterfallplot::scaleDivChanged()
             plotToUpdate = m_plotVertCurve;
         }
 
-        plotToUpdate->setAxisScaleDiv(axisId, updatedPlot->axisScaleDiv(axisId));
-        updateLayout();
+        // queued: the time axis scrolled by replotView() is already synced
+        const QwtScaleDiv& scaleDiv = updatedPlot->axisScaleDiv(axisId);
+        if (!(plotToUpdate->axisScaleDiv(axisId) == scaleDiv))
+        {
+            plotToUpdate->setAxisScaleDiv(axisId, scaleDiv);
+            updateLayout();
+        }
     }
     
     m_inScaleSync = false;
@@ -761,8 +1578,171 @@ void Waterfallplot::alignAxisForColorBar()
     s2->scaleDraw()->setMinimumExtent(extent);
 }
 
+void Waterfallplot::updateEventMarkers()
+{
+    size_t used = 0;
+
+    const WaterfallDetector<double>* const eventsDetector = detector();
+    if (eventsDetector)
+    {
+        // only the events of the visible window are shown
+        const QwtScaleDiv& xDiv = m_plotSpectrogram->axisScaleDiv(QwtPlot::xBottom);
+        const QwtScaleDiv& yDiv = m_plotSpectrogram->axisScaleDiv(QwtPlot::yLeft);
+        const auto events = eventsDetector->events(std::floor(yDiv.lowerBound()), yDiv.upperBound());
+
+        for (auto it = events.first; it != events.second && used < s_maxEventMarkers; ++it)
+        {
+            const double x = m_data->getBinCenter(it->peakCol);
+            if (!xDiv.contains(x))
+            {
+                continue;
+            }
+
+            if (used == m_eventMarkers.size())
+            {
+                QwtPlotMarker* const marker = new QwtPlotMarker;
+                marker->setSymbol(new QwtSymbol(QwtSymbol::Ellipse, Qt::NoBrush,
+                                                QPen(Qt::white, 2), QSize(9, 9)));
+                marker->attach(m_plotSpectrogram);
+                m_eventMarkers.push_back(marker);
+            }
+
+            QwtPlotMarker* const marker = m_eventMarkers[used++];
+            marker->setValue(x, it->layer + 0.5); // center of the layer
+            marker->setVisible(true);
+        }
+    }
+
+    for (size_t i = used; i < m_eventMarkers.size(); ++i)
+    {
+        m_eventMarkers[i]->setVisible(false);
+    }
+}
+
+WaterfallStats Waterfallplot::stats() const
+{
+    WaterfallStats result;
+    for (int stage = 0; stage < WaterfallProfiler::StageCount; ++stage)
+    {
+        const WaterfallHistogram& histogram = m_profiler.histogram(WaterfallProfiler::Stage(stage));
+        result.stages[stage].count = histogram.count();
+        result.stages[stage].p50Ns = histogram.quantile(0.5);
+        result.stages[stage].p99Ns = histogram.quantile(0.99);
+    }
+
+    result.droppedFrames = m_droppedFrames;
+    result.layersPerSecond = m_layersPerSecond;
+
+    const size_t curvesPoints = 2 * (m_curvesLayerPoints + m_curvesHistoryExtent);
+    result.memoryBytes = curvesPoints * sizeof(double) + ((m_data) ? m_data->getMemoryUsage() : 0) +
+                         m_colorRing.getMemoryUsage() +
+                         static_cast<const WaterfallSpectrogram*>(m_spectrogram)->getMemoryUsage();
+    return result;
+}
+
+void Waterfallplot::resetStats()
+{
+    m_profiler.reset();
+    m_droppedFrames = 0;
+    m_rateLayers = 0;
+    m_layersPerSecond = 0.;
+    m_rateStart = std::chrono::steady_clock::now();
+}
+
+void Waterfallplot::setColorRingEnabled(const bool enabled)
+{
+    if (enabled == m_colorRing.isEnabled())
+    {
+        return;
+    }
+
+    double dLower;
+    double dUpper;
+    getRange(dLower, dUpper);
+    m_colorRing.setRange(dLower, dUpper, nullptr);
+    m_colorRing.setEnabled(enabled, m_data);
+    m_spectrogram->invalidateCache();
+    markDirty(DirtySpectrogram);
+}
+
+void Waterfallplot::setRenderThreadCount(const size_t count)
+{
+    m_spectrogram->setRenderThreadCount(uint(count));
+}
+
+size_t Waterfallplot::getRenderThreadCount() const
+{
+    return m_spectrogram->renderThreadCount();
+}
+
+void Waterfallplot::setRenderTileSize(const int size)
+{
+    static_cast<WaterfallSpectrogram*>(m_spectrogram)->setTileSize(size);
+}
+
+int Waterfallplot::getRenderTileSize() const
+{
+    return static_cast<const WaterfallSpectrogram*>(m_spectrogram)->getTileSize();
+}
+
+void Waterfallplot::setSpectrogramPaintedCallback(const std::function<void()>& painted)
+{
+    static_cast<WaterfallSpectrogram*>(m_spectrogram)->setPaintedCallback(painted);
+}
+
+void Waterfallplot::setStatsOverlayVisible(const bool visible)
+{
+    if (visible && !m_statsOverlay)
+    {
+        m_statsOverlay = new QwtPlotTextLabel;
+        m_statsOverlay->setZ(1000); // above the spectrogram and the markers
+        m_statsOverlay->attach(m_plotSpectrogram);
+    }
+    if (m_statsOverlay)
+    {
+        m_statsOverlay->setVisible(visible);
+        updateStatsOverlay();
+    }
+    markDirty(DirtySpectrogram);
+}
+
+void Waterfallplot::updateStatsOverlay()
+{
+    if (!m_statsOverlay || !m_statsOverlay->isVisible())
+    {
+        return;
+    }
+
+    const WaterfallStats current = stats();
+
+    QString lines = QString("%1 layers/s, %2 dropped, %3 MiB")
+            .arg(current.layersPerSecond, 0, 'f', 1)
+            .arg(current.droppedFrames)
+            .arg(current.memoryBytes / (1024. * 1024.), 0, 'f', 1);
+#ifdef WATERFALL_ENABLE_PROFILING
+    for (int stage = 0; stage < WaterfallProfiler::StageCount; ++stage)
+    {
+        lines += QString("\n%1: p50 %2 ms, p99 %3 ms")
+                .arg(WaterfallProfiler::stageName(WaterfallProfiler::Stage(stage)))
+                .arg(current.stages[stage].p50Ns / 1e6, 0, 'f', 3)
+                .arg(current.stages[stage].p99Ns / 1e6, 0, 'f', 3);
+    }
+#endif
+
+    QColor background(Qt::white);
+    background.setAlpha(200);
+
+    QwtText text(lines);
+    text.setRenderFlags(Qt::AlignLeft | Qt::AlignTop);
+    text.setBackgroundBrush(QBrush(background));
+    text.setColor(Qt::black);
+    m_statsOverlay->setText(text);
+}
+
 void Waterfallplot::updateLayout()
 {
+    WATERFALL_PROFILE_SCOPE(m_profiler, WaterfallProfiler::Layout);
+
     // 1. Align Vertical Axis (only left or right)
     alignAxis(QwtPlot::yLeft);
     alignAxisForColorBar();
@@ -775,11 +1755,16 @@ void Waterfallplot::updateLayout()
 
 void Waterfallplot::updateCurvesData()
 {
+    WATERFALL_PROFILE_SCOPE(m_profiler, WaterfallProfiler::Curves);
+
+    // an extraction in flight would now be outdated
+    m_curveExtractor.cancel();
+    markDirty(DirtyHorCurve | DirtyVertCurve);
+
     // refresh curve's data
     const size_t currentHistory = m_data->getHistoryLength();
     const size_t layerPts   = m_data->getLayerPoints();
     const size_t maxHistory = m_data->getMaxHistoryLength();
-    const double* wfData = m_data->getData();
 
     const size_t markerY = m_markerY;
     if (markerY >= maxHistory)
@@ -789,20 +1774,55 @@ void Waterfallplot::updateCurvesData()
 
     if (m_horCurveXAxisData && m_horCurveYAxisData)
     {
-        std::copy(wfData + layerPts * markerY,
-                  wfData + layerPts * (markerY + 1),
-                  m_horCurveYAxisData);
+        const double* layer = m_data->getLayer(markerY);
+        std::copy(layer, layer + layerPts, m_horCurveYAxisData);
         m_horCurve->setRawSamples(m_horCurveXAxisData, m_horCurveYAxisData, layerPts);
     }
 
+    // traces are maintained by m_data, the curves point directly to them
+    const WaterfallTraces<double>& traces = m_data->traces();
+    if (m_horCurveXAxisData && traces.isEnabled() && traces.count() > 0 && traces.size() == layerPts)
+    {
+        m_maxHoldCurve->setRawSamples(m_horCurveXAxisData, traces.maxHold(), layerPts);
+        m_averageCurve->setRawSamples(m_horCurveXAxisData, traces.average(), layerPts);
+        m_minHoldCurve->setRawSamples(m_horCurveXAxisData, traces.minHold(), layerPts);
+    }
+    else
+    {
+        m_maxHoldCurve->setSamples(QVector<QPointF>());
+        m_averageCurve->setSamples(QVector<QPointF>());
+        m_minHoldCurve->setSamples(QVector<QPointF>());
+    }
+
+    const WaterfallStatistics<double>& statistics = m_data->statistics();
+    if (m_horCurveXAxisData && statistics.isEnabled() && statistics.count() > 0 && statistics.size() == layerPts)
+    {
+        m_meanCurve->setRawSamples(m_horCurveXAxisData, statistics.mean(), layerPts);
+        if (m_showNoiseFloor)
+        {
+            m_noiseFloorCurve->setRawSamples(m_horCurveXAxisData, statistics.noiseFloor(), layerPts);
+        }
+        else
+        {
+            // the quantiles are only computed when shown, no pointer to outdated buffers is kept
+            m_noiseFloorCurve->setSamples(QVector<QPointF>());
+        }
+    }
+    else
+    {
+        m_meanCurve->setSamples(QVector<QPointF>());
+        m_noiseFloorCurve->setSamples(QVector<QPointF>());
+    }
+
     const double offset = m_data->getOffset();
 
     if (currentHistory > 0 && m_vertCurveXAxisData && m_vertCurveYAxisData)
     {
+        const size_t col = m_data->getColumn(m_markerX);
         size_t dataIndex = 0;
         for (size_t layer = maxHistory - currentHistory; layer < maxHistory; ++layer, ++dataIndex)
         {
-            const double z = m_data->value(m_markerX, layer + size_t(offset));
+            const double z = m_data->getLayer(layer)[col];
             const double t = double(layer) + offset;
             m_vertCurveXAxisData[dataIndex] = z;
             m_vertCurveYAxisData[dataIndex] = t;
@@ -816,37 +1836,45 @@ void Waterfallplot::updateCurvesData()
 
         //m_plotVertCurve->setAxisScale(QwtPlot::xBottom, rangeMin, rangeMax);
     }
+    else if (m_vertCurve)
+    {
+        m_vertCurve->setSamples(QVector<QPointF>());
+    }
 }
 
 void Waterfallplot::allocateCurvesData()
 {
-    if (m_horCurveXAxisData || m_horCurveYAxisData || m_vertCurveXAxisData ||
-        m_vertCurveYAxisData || !m_data)
+    if (!m_data)
     {
         return;
     }
 
     const size_t layerPoints = m_data->getLayerPoints();
-    const double dXMin = m_data->getXMin();
-    const double dXMax = m_data->getXMax();
     const size_t historyExtent = m_data->getMaxHistoryLength();
 
-    m_horCurveXAxisData  = new double[layerPoints];
-    m_horCurveYAxisData  = new double[layerPoints];
-    m_vertCurveXAxisData = new double[historyExtent];
-    m_vertCurveYAxisData = new double[historyExtent];
+    // the arrays are only reallocated when the dimensions changed
+    if (layerPoints != m_curvesLayerPoints || !m_horCurveXAxisData)
+    {
+        delete [] m_horCurveXAxisData;
+        delete [] m_horCurveYAxisData;
+        m_horCurveXAxisData = new double[layerPoints];
+        m_horCurveYAxisData = new double[layerPoints];
+        m_curvesLayerPoints = layerPoints;
+    }
+    if (historyExtent != m_curvesHistoryExtent || !m_vertCurveXAxisData)
+    {
+        delete [] m_vertCurveXAxisData;
+        delete [] m_vertCurveYAxisData;
+        m_vertCurveXAxisData = new double[historyExtent];
+        m_vertCurveYAxisData = new double[historyExtent];
+        m_curvesHistoryExtent = historyExtent;
+    }
 
     // generate curve X axis data
-    const double dx = (dXMax - dXMin) / layerPoints; // x spacing
-    m_horCurveXAxisData[0] = dXMin;
-    for (size_t x = 1u; x < layerPoints; ++x)
+    for (size_t x = 0u; x < layerPoints; ++x)
     {
-        m_horCurveXAxisData[x] = m_horCurveXAxisData[x - 1] + dx;
+        m_horCurveXAxisData[x] = m_data->getBinEdge(x);
     }
-
-    // Reset marker to the default position
-    m_markerX = (dXMax - dXMin) / 2;
-    m_markerY = historyExtent - 1;
 }
 
 void Waterfallplot::freeCurvesData()
@@ -871,6 +1899,8 @@ void Waterfallplot::freeCurvesData()
         delete [] m_vertCurveYAxisData;
         m_vertCurveYAxisData = nullptr;
     }
+    m_curvesLayerPoints = 0;
+    m_curvesHistoryExtent = 0;
 }
 
 void Waterfallplot::setPickerEnabled(const bool enabled)
@@ -886,6 +1916,21 @@ void Waterfallplot::setPickerEnabled(const bool enabled)
 }
 
 bool Waterfallplot::setMarker(const double x, const double y)
+{
+    if (!moveMarker(x, y))
+    {
+        return false;
+    }
+
+    updateCurvesData();
+
+    m_plotHorCurve->replot();
+    m_plotVertCurve->replot();
+
+    return true;
+}
+
+bool Waterfallplot::moveMarker(const double x, const double y)
 {
     if (!m_data)
     {
@@ -908,19 +1953,77 @@ bool Waterfallplot::setMarker(const double x, const double y)
     m_horCurveMarker->setValue(m_markerX, 0.0);
     m_vertCurveMarker->setValue(0.0, y);
 
-    updateCurvesData();
-
-    m_plotHorCurve->replot();
-    m_plotVertCurve->replot();
-
     return true;
 }
 
 void Waterfallplot::selectedPoint(const QPointF& pt)
 {
+    // end of the drag: the final position is applied right away
+    m_pickTimer->stop();
     setMarker(pt.x(), pt.y());
 }
 
+void Waterfallplot::movedPoint(const QPointF& pt)
+{
+    m_pickPoint = pt;
+    if (!m_pickTimer->isActive())
+    {
+        m_pickTimer->start();
+    }
+}
+
+void Waterfallplot::requestPickedCurves()
+{
+    if (!moveMarker(m_pickPoint.x(), m_pickPoint.y()))
+    {
+        return;
+    }
+
+    // the markers are redrawn with the curves once the extraction is done
+    m_curveExtractor.request(m_data, size_t(m_markerY), m_data->getColumn(m_markerX));
+}
+
+void Waterfallplot::applyPickedCurves()
+{
+    if (!m_data || !m_curveExtractor.take(m_pickResult))
+    {
+        return;
+    }
+
+    const WaterfallCurveExtractor::Result& result = m_pickResult;
+    const size_t layerPts = m_data->getLayerPoints();
+    if (result.layerPoints != layerPts || result.maxHistory != m_data->getMaxHistoryLength() ||
+        result.offset != m_data->getOffset() || result.layer.size() != layerPts ||
+        !m_horCurveYAxisData || !m_vertCurveXAxisData || !m_vertCurveYAxisData)
+    {
+        // the data changed without going through updateCurvesData() (e.g. frozen)
+        updateCurvesData();
+    }
+    else
+    {
+        std::copy(result.layer.cbegin(), result.layer.cend(), m_horCurveYAxisData);
+        m_horCurve->setRawSamples(m_horCurveXAxisData, m_horCurveYAxisData, layerPts);
+
+        const size_t count = result.column.size();
+        for (size_t i = 0; i < count; ++i)
+        {
+            m_vertCurveXAxisData[i] = result.column[i];
+            m_vertCurveYAxisData[i] = double(result.firstRow + i) + result.offset;
+        }
+        if (count > 0)
+        {
+            m_vertCurve->setRawSamples(m_vertCurveXAxisData, m_vertCurveYAxisData, count);
+        }
+        else
+        {
+            m_vertCurve->setSamples(QVector<QPointF>());
+        }
+    }
+
+    m_plotHorCurve->replot();
+    m_plotVertCurve->replot();
+}
+
 void Waterfallplot::setupCurves()
 {
     m_plotHorCurve->detachItems(QwtPlotItem::Rtti_PlotCurve, true);
@@ -928,6 +2031,11 @@ void Waterfallplot::setupCurves()
 
     m_horCurve = new QwtPlotCurve;
     m_vertCurve = new QwtPlotCurve;
+    m_maxHoldCurve = new QwtPlotCurve("Max hold");
+    m_averageCurve = new QwtPlotCurve("Average");
+    m_minHoldCurve = new QwtPlotCurve("Min hold");
+    m_meanCurve = new QwtPlotCurve("Mean");
+    m_noiseFloorCurve = new QwtPlotCurve("Noise floor");
 
     /* Horizontal Curve */
     m_horCurve->attach(m_plotHorCurve);
@@ -937,6 +2045,30 @@ void Waterfallplot::setupCurves()
     m_horCurve->setStyle(QwtPlotCurve::Lines);
     //m_curve->setSymbol(new QwtSymbol(QwtSymbol::Style...,Qt::NoBrush, QPen..., QSize(5, 5)));
 
+    /* Traces (overlaid on the horizontal curve) */
+    m_maxHoldCurve->setPen(QColor(Qt::red), 0, Qt::DashLine);
+    m_averageCurve->setPen(QColor(Qt::darkGreen), 0, Qt::DashLine);
+    m_minHoldCurve->setPen(QColor(Qt::darkBlue), 0, Qt::DashLine);
+    for (QwtPlotCurve* trace : { m_maxHoldCurve, m_averageCurve, m_minHoldCurve })
+    {
+        trace->setStyle(QwtPlotCurve::Lines);
+        trace->attach(m_plotHorCurve);
+    }
+    m_maxHoldCurve->setVisible(m_showMaxHold);
+    m_averageCurve->setVisible(m_showAverage);
+    m_minHoldCurve->setVisible(m_showMinHold);
+
+    /* Statistics (overlaid on the horizontal curve) */
+    m_meanCurve->setPen(QColor(Qt::darkMagenta), 0, Qt::DotLine);
+    m_noiseFloorCurve->setPen(QColor(Qt::darkGray), 0, Qt::DotLine);
+    for (QwtPlotCurve* curve : { m_meanCurve, m_noiseFloorCurve })
+    {
+        curve->setStyle(QwtPlotCurve::Lines);
+        curve->attach(m_plotHorCurve);
+    }
+    m_meanCurve->setVisible(m_showMean);
+    m_noiseFloorCurve->setVisible(m_showNoiseFloor);
+
     /* Vertical Curve */
     m_vertCurve->attach(m_plotVertCurve);
     m_vertCurve->setRenderHint(QwtPlotItem::RenderAntialiased, true);
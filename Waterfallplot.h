@@ -1,10 +1,22 @@
 #ifndef WATERFALLPLOT_H
 #define WATERFALLPLOT_H
 
+#include <QPointF>
 #include <QWidget>
 
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
 #include "ColorMaps.h"
+#include "WaterfallAccumulator.h"
+#include "WaterfallColorRing.h"
+#include "WaterfallCurveExtractor.h"
 #include "WaterfallData.h"
+#include "WaterfallProfiler.h"
+#include "WaterfallSession.h"
+#include "WaterfallStore.h"
 
 class QwtPlot;
 class QwtPlotCurve;
@@ -12,7 +24,9 @@ class QwtPlotMarker;
 class QwtPlotPanner;
 class QwtPlotPicker;
 class QwtPlotSpectrogram;
+class QwtPlotTextLabel;
 class QwtPlotZoomer;
+class QTimer;
 
 class Waterfallplot : public QWidget
 {
@@ -20,7 +34,9 @@ public:
     Waterfallplot(QWidget* parent, const ColorMaps::ControlPoints& ctrlPts = ColorMaps::Jet());
     ~Waterfallplot() override;
 
-    void setDataDimensions(double dXMin, double dXMax, // X bounds, fixed once for all
+    // when called again, the history is preserved (resampled to the new dimensions),
+    // returns false if the dimensions are invalid
+    bool setDataDimensions(double dXMin, double dXMax, // X bounds
                            const size_t historyExtent, // Will define Y width (number of layers)
                            const size_t layerPoints);  // FFT/Data points in a single layer)
     void getDataDimensions(double& dXMin,
@@ -30,8 +46,26 @@ public:
 
     bool setMarker(const double x, const double y);
 
+    /* This plot becomes another view of the data of other (whose dimensions must be set):
+     * the history is stored once and the layers added through any of the views are shown
+     * by all of them. The history, bins, rebin mode, traces, statistics and detector are
+     * shared, the range, color map, zoom, markers, integration and freeze are per view. */
+    bool shareData(const Waterfallplot& other);
+    const std::shared_ptr<WaterfallStore>& store() const { return m_store; }
+
+    // non-uniform X bins (layerPoints + 1 ascending edges), an empty array restores uniform bins
+    bool setBinEdges(const std::vector<double>& edges);
+    void setXAxisLogarithmic(const bool logarithmic); // X bounds must be > 0
+
     // view
-    void replot(bool forceRepaint = false);
+    void replot(bool forceRepaint = false); // every view of the data (frozen ones: see setFrozen())
+    /* Freeze: the visible window stays pinned to absolute layers while addData()
+     * keeps absorbing layers without redrawing anything. The view's own changes
+     * (range, color map, overlays...) are still drawn at the pinned window (layers
+     * evicted meanwhile are drawn empty). Resuming jumps to live in a single redraw
+     * (a zoomed window is moved by the absorbed layers). */
+    void setFrozen(const bool frozen);
+    bool isFrozen() const { return m_frozen; }
     void setWaterfallVisibility(const bool bVisible);
     void setTitle(const QString& qstrNewTitle);
     void setXLabel(const QString& qstrTitle, const int fontPointSize = 12);
@@ -40,7 +74,10 @@ public:
     void setXTooltipUnit(const QString& xUnit);
     void setZTooltipUnit(const QString& zUnit);
     bool setColorMap(const ColorMaps::ControlPoints& colorMap);
+    // baked color map (see ColorMaps::preset()): after the first one, switching is a pointer swap
+    void setColorMap(const ColorMaps::ColorMap& colorMap);
     ColorMaps::ControlPoints getColorMap() const;
+    const ColorMaps::ColorMap* getColorMapPreset() const { return m_preset; } // null: control points
     QwtPlot* getHorizontalCurvePlot() const { return m_plotHorCurve; }
     QwtPlot* getVerticalCurvePlot() const { return m_plotVertCurve; }
     QwtPlot* getSpectrogramPlot() const { return m_plotSpectrogram; }
@@ -53,8 +90,77 @@ public:
     void clear();
     time_t getLayerDate(const double y) const;
 
+    // resampling of the layers whose length differs from the layer points (e.g. FFT size change)
+    void setRebinMode(const WaterfallData<double>::RebinMode mode);
+    WaterfallData<double>::RebinMode getRebinMode() const { return m_rebinMode; }
+
+    // integration of the incoming frames: a layer is only added to the waterfall
+    // when the window (frames and/or msecs) is complete, addData() then returns true
+    // for every absorbed frame.
+    void setIntegration(const WaterfallAccumulator<double>::Mode mode,
+                        const size_t frames,
+                        const int msecs = 0,
+                        const double alpha = 0.1); // Exponential mode only
+    WaterfallAccumulator<double>::Mode getIntegrationMode() const { return m_accumulator.getMode(); }
+
+    // max-hold, average and min-hold traces overlaid on the horizontal curve
+    void setTracesVisible(const bool maxHold, const bool average, const bool minHold);
+    void setTracesWindow(const size_t layers); // 0: every layer since the last clear
+
+    /* per-column statistics over the history. The noise floor is estimated from a histogram
+     * of sketchBins bins per column over [sketchMin, sketchMax] (resolution: (sketchMax - sketchMin)
+     * / sketchBins, values outside fall in the end bins). The sketch belongs to the data, shared
+     * views use the same one. With sketchMin >= sketchMax (the default) it covers the range of the
+     * view when the statistics are enabled, and it isn't rebuilt when the range changes. */
+    void setStatisticsEnabled(const bool enabled);
+    void setStatisticsSketch(const double sketchMin, const double sketchMax, const size_t sketchBins = 64);
+    void setStatisticsCurvesVisible(const bool mean, const bool noiseFloor);
+    const WaterfallStatistics<double>* statistics() const;
+
+    // events detection on the incoming layers, events of the visible window are shown with markers.
+    // The noise floor margin requires the statistics.
+    void setDetectorEnabled(const bool enabled);
+    void setDetectorThreshold(const bool enabled, const double threshold);
+    void setDetectorNoiseFloorMargin(const bool enabled, const double margin);
+    const WaterfallDetector<double>* detector() const;
+
     double getOffset() const { return (m_data) ? m_data->getOffset() : 0; }
 
+    /* per-stage durations (p50/p99, requires WATERFALL_ENABLE_PROFILING), dropped frames,
+     * ingest rate and memory used, can be shown on the spectrogram canvas */
+    WaterfallStats stats() const;
+    void resetStats();
+    void setStatsOverlayVisible(const bool visible);
+    // called once the spectrogram is painted, e.g. to measure the display latency
+    void setSpectrogramPaintedCallback(const std::function<void()>& painted);
+
+    /* Pre-colorized rows (4 bytes per value): the layers are colorized once when they're
+     * added and drawing the spectrogram is a copy of these pixels, a range or color map
+     * change recolors them from the raw data. Not used with a logarithmic X axis. */
+    void setColorRingEnabled(const bool enabled);
+    bool isColorRingEnabled() const { return m_colorRing.isEnabled(); }
+
+    /* The spectrogram is rasterized in square tiles on a persistent work-stealing
+     * pool (see WaterfallTilePool): threads used per render (0: hardware
+     * concurrency, the default) and side of the tiles in pixels (64 by default). */
+    void setRenderThreadCount(const size_t count);
+    size_t getRenderThreadCount() const;
+    void setRenderTileSize(const int size);
+    int getRenderTileSize() const;
+
+    /* Sessions: the data (dimensions, bins, history and timestamps) with this view's
+     * range, color map and marker, e.g. for a warm startup. A session file is restored
+     * by mapping it, without parsing nor copying the history (see WaterfallSession.h),
+     * the restored data can't grow beyond its dimensions. The autosave saves the
+     * session every msecs (0: disabled) when layers were added, on a worker thread. */
+    bool saveSession(const QString& fileName, QString* const error = nullptr);
+    bool restoreSession(const QString& fileName, QString* const error = nullptr);
+    void setAutosave(const QString& fileName, const int msecs);
+    const WaterfallSessionWriter& sessionWriter() const { return m_sessionWriter; } // autosave results
+
+    // null until setDataDimensions() is called (e.g. for WaterfallExporter::snapshot())
+    const WaterfallData<double>* data() const { return m_data; }
+
     QString m_xUnit;
     QString m_zUnit;
 
@@ -65,6 +171,7 @@ protected slots:
     void autoRescale(const QRectF& rect);
 
     void selectedPoint(const QPointF& pt);
+    void movedPoint(const QPointF& pt);
 
 protected:
     QwtPlot* const            m_plotHorCurve = nullptr;
@@ -72,6 +179,11 @@ protected:
     QwtPlot* const            m_plotSpectrogram = nullptr;
     QwtPlotCurve*             m_horCurve = nullptr;
     QwtPlotCurve*             m_vertCurve = nullptr;
+    QwtPlotCurve*             m_maxHoldCurve = nullptr;
+    QwtPlotCurve*             m_averageCurve = nullptr;
+    QwtPlotCurve*             m_minHoldCurve = nullptr;
+    QwtPlotCurve*             m_meanCurve = nullptr;
+    QwtPlotCurve*             m_noiseFloorCurve = nullptr;
     QwtPlotPicker* const      m_picker = nullptr;
     QwtPlotPanner* const      m_panner = nullptr;
     QwtPlotSpectrogram* const m_spectrogram = nullptr;
@@ -80,10 +192,13 @@ protected:
     QwtPlotMarker* const      m_vertCurveMarker = nullptr;
 
     // later, the type can be parametrized when instanciating Waterfallplot
-    // m_pData will be owned (freed) by m_spectrogram
+    // m_data belongs to m_store (possibly shared with other views), m_spectrogram
+    // owns m_rasterView which reads it.
     // Sadly, to avoid compile problems with a templated class, the implementation
     // needs to be moved in this header file !
-    WaterfallData<double>* m_data = nullptr;
+    std::shared_ptr<WaterfallStore> m_store;
+    WaterfallData<double>*          m_data = nullptr;
+    WaterfallRasterView*            m_rasterView = nullptr;
 
     bool m_bColorBarInitialized = false;
 
@@ -93,25 +208,117 @@ protected:
     double* m_vertCurveXAxisData = nullptr;
     double* m_vertCurveYAxisData = nullptr;
 
+    size_t m_curvesLayerPoints = 0;
+    size_t m_curvesHistoryExtent = 0;
+
     mutable bool m_inScaleSync = false;
 
     double m_markerX = 0;
     double m_markerY = 0;
 
-    ColorMaps::ControlPoints m_ctrlPts;
+    /* picker drag: the moves are coalesced to one curves update per frame and the
+     * marker's row/column are extracted on a worker, results made stale by a newer
+     * move (or by updateCurvesData()) are discarded */
+    QTimer*                         m_pickTimer = nullptr;
+    QPointF                         m_pickPoint;
+    WaterfallCurveExtractor         m_curveExtractor;
+    WaterfallCurveExtractor::Result m_pickResult;
+
+    ColorMaps::ControlPoints   m_ctrlPts;
+    const ColorMaps::ColorMap* m_preset = nullptr; // when set, m_ctrlPts is unused
 
     bool m_zoomActive = false;
 
+    bool   m_frozen = false;
+    double m_frozenOffset = 0;
+
+    WaterfallAccumulator<double> m_accumulator;
+
+    WaterfallColorRing m_colorRing;
+
+    WaterfallData<double>::RebinMode m_rebinMode = WaterfallData<double>::NoRebin;
+
+    bool   m_showMaxHold = false;
+    bool   m_showAverage = false;
+    bool   m_showMinHold = false;
+    size_t m_tracesWindow = 0;
+
+    bool   m_statisticsEnabled = false;
+    double m_sketchMin = 0.; // sketch of new data, then the store owns it (sketchMin >= sketchMax: the range)
+    double m_sketchMax = 0.;
+    size_t m_sketchBins = 64;
+    bool m_showMean = false;
+    bool m_showNoiseFloor = false;
+
+    bool   m_detectorEnabled = false;
+    bool   m_detectorUseThreshold = false;
+    double m_detectorThreshold = 0.;
+    bool   m_detectorUseNoiseFloor = false;
+    double m_detectorMargin = 0.;
+    std::vector<QwtPlotMarker*> m_eventMarkers;
+    static const size_t s_maxEventMarkers = 512;
+
+    WaterfallProfiler m_profiler;
+    uint64_t          m_droppedFrames = 0;
+    size_t            m_rateLayers = 0;
+    double            m_layersPerSecond = 0.;
+    std::chrono::steady_clock::time_point m_rateStart = std::chrono::steady_clock::now();
+    QwtPlotTextLabel* m_statsOverlay = nullptr;
+
+    /* what changed since the last replot: a frame of layers only dirties the canvases
+     * (Qwt repaints the axes whose ticks moved), the layout is redone for other changes.
+     * A replot without any recorded change redraws everything. */
+    enum DirtyFlag
+    {
+        DirtySpectrogram = 0x1, // canvases
+        DirtyHorCurve    = 0x2,
+        DirtyVertCurve   = 0x4,
+        DirtyLayout      = 0x8, // axes alignment, scales, color bar
+        DirtyAll         = 0xf,
+        DirtyFrozenLayer = 0x10 // layers absorbed while frozen, nothing to redraw
+    };
+    int m_dirty = DirtyAll;
+
+    // after m_store: the autosave is done before the data is released
+    WaterfallSessionWriter m_sessionWriter;
+    QTimer*                m_autosaveTimer = nullptr;
+    QString                m_autosaveFile;
+    const WaterfallStore*  m_autosavedStore = nullptr;
+    quint64                m_autosavedGeneration = 0;
+
 protected slots:
    void scaleDivChanged();
 
 protected:
     void updateLayout();
 
+    bool addLayer(const double* const dataPtr, const size_t dataLen, const time_t timestamp);
+
+    // store notifications (whichever view changed the data)
+    void attachStore(const std::shared_ptr<WaterfallStore>& store);
+    void layerAdded();
+    void dataReset();
+    void replotView(const bool forceRepaint);
+    void markDirty(const int flags) { m_dirty |= flags; }
+    void replotCanvas(QwtPlot* const plot, const int flag, const bool forceRepaint);
+
+    bool moveMarker(const double x, const double y);
+    void requestPickedCurves();
+    void applyPickedCurves();
+
+    void setupData();
+    bool resizeData(double dXMin, double dXMax, const size_t historyExtent, const size_t layerPoints);
+
+    void autosave();
+    WaterfallSessionView sessionView() const;
+
     void allocateCurvesData();
     void freeCurvesData();
     void setupCurves();
     void updateCurvesData();
+    void updateEventMarkers();
+    void updateStatsOverlay();
+    void applyDetectorSettings();
 
 private:
     //Q_DISABLE_COPY(Waterfallplot)
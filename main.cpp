@@ -1,6 +1,5 @@
 #include <algorithm>
-#include <cassert>
-#include <cstdlib>
+#include <chrono>
 #include <ctime>
 #include <vector>
 
@@ -12,13 +11,21 @@
 #include <qslider.h>
 #include <qlabel.h>
 #include <qcheckbox.h>
-#include <QThread>
+#include <qlineedit.h>
+#include <qspinbox.h>
+#include <qstatusbar.h>
+#include <QFile>
+#include <QTimer>
 #include <QVBoxLayout>
 
 #include <qwt_color_map.h>
 #include <qwt_plot_renderer.h>
 
 #include "ExportDialog.h"
+#include "LoadGenerator.h"
+#include "WaterfallExporter.h"
+#include "WaterfallProfiler.h"
+#include "WaterfallSource.h"
 #include "Waterfallplot.h"
 
 class MainWindow: public QMainWindow
@@ -29,18 +36,44 @@ public:
 public slots:
     void changeColorMap();
     void exportPlots();
-    void playData();
+    void playData(const bool play);
     void clearWaterfall();
+    void openView();
 
 private:
+    void exportData();
+    void addGeneratedLayers();
+    void recordDisplayLatency();
+    void updateLoadStats();
+
     Waterfallplot* m_waterfall = nullptr;
+
+    WaterfallExporter* m_exporter = nullptr;
+    std::vector<std::pair<QString, WaterfallExporter::Format>> m_pendingExports;
+
+    // load generator (settings in the second toolbar)
+    LoadGenerator*                  m_generator = nullptr;
+    std::vector<LoadGenerator::Layer> m_generatedLayers;
+    WaterfallHistogram              m_latency; // generation to display
+    // generation of the layers added since the spectrogram was last painted
+    std::vector<std::chrono::steady_clock::time_point> m_undisplayed;
+    QSpinBox*                       m_rateBox = nullptr;
+    QSpinBox*                       m_pointsBox = nullptr;
+    QSpinBox*                       m_historyBox = nullptr;
+    QSpinBox*                       m_burstBox = nullptr;
+    QComboBox*                      m_typeBox = nullptr;
+    QComboBox*                      m_shapeBox = nullptr;
+    QLabel*                         m_loadStats = nullptr;
+    static const size_t             s_maxUndisplayed = 1 << 20; // e.g. while minimized
+
+    // streaming data source (serial port, socket or pipe)
+    WaterfallSource* m_source = nullptr;
+    QLineEdit*       m_sourceEdit = nullptr;
 };
 
 MainWindow::MainWindow( QWidget *parent ) :
     QMainWindow( parent )
 {
-    srand(time(nullptr));
-
     QWidget *centralWidget = new QWidget(this);
 
     QVBoxLayout* layout = new QVBoxLayout(centralWidget);
@@ -79,9 +112,10 @@ MainWindow::MainWindow( QWidget *parent ) :
     QToolButton* btnPlayData = new QToolButton(toolBar);
     btnPlayData->setIcon(style()->standardIcon(QStyle::SP_MediaPlay));
     btnPlayData->setToolButtonStyle(Qt::ToolButtonIconOnly);
-    btnPlayData->setToolTip("Play 32 random data (layers) on the waterfall view.");
+    btnPlayData->setCheckable(true);
+    btnPlayData->setToolTip("Start/stop the synthetic load generator (settings in the load toolbar).");
     toolBar->addWidget(btnPlayData);
-    QObject::connect(btnPlayData, &QToolButton::clicked, this, &MainWindow::playData);
+    QObject::connect(btnPlayData, &QToolButton::toggled, this, &MainWindow::playData);
 
     QToolButton* btnPicker = new QToolButton(toolBar);
     btnPicker->setText( "Pick" );
@@ -91,13 +125,185 @@ MainWindow::MainWindow( QWidget *parent ) :
     toolBar->addWidget(btnPicker);
     QObject::connect(btnPicker, &QToolButton::toggled, m_waterfall, &Waterfallplot::setPickerEnabled);
 
+    QToolButton* btnFreeze = new QToolButton(toolBar);
+    btnFreeze->setText("Freeze");
+    btnFreeze->setCheckable(true);
+    btnFreeze->setToolButtonStyle( Qt::ToolButtonTextUnderIcon );
+    btnFreeze->setToolTip("Freeze the view while the data keeps being received.");
+    toolBar->addWidget(btnFreeze);
+    QObject::connect(btnFreeze, &QToolButton::toggled, m_waterfall, &Waterfallplot::setFrozen);
+
+    QToolButton* btnStats = new QToolButton(toolBar);
+    btnStats->setText("Stats");
+    btnStats->setCheckable(true);
+    btnStats->setToolButtonStyle( Qt::ToolButtonTextUnderIcon );
+    toolBar->addWidget(btnStats);
+    QObject::connect(btnStats, &QToolButton::toggled, this, [this](const bool checked)
+    {
+        m_waterfall->setStatsOverlayVisible(checked);
+        m_waterfall->replot();
+    });
+
+    QToolButton* btnColorRing = new QToolButton(toolBar);
+    btnColorRing->setText("RGB rows");
+    btnColorRing->setCheckable(true);
+    btnColorRing->setToolButtonStyle( Qt::ToolButtonTextUnderIcon );
+    btnColorRing->setToolTip("Colorize the layers once when they're received (uses 4 bytes per value).");
+    toolBar->addWidget(btnColorRing);
+    QObject::connect(btnColorRing, &QToolButton::toggled, this, [this](const bool checked)
+    {
+        m_waterfall->setColorRingEnabled(checked);
+        m_waterfall->replot();
+    });
+
     QToolButton* btnClear = new QToolButton(toolBar);
     btnClear->setText("Clear");
     btnClear->setToolButtonStyle( Qt::ToolButtonTextUnderIcon );
     toolBar->addWidget(btnClear);
     QObject::connect(btnClear, &QToolButton::clicked, this, &MainWindow::clearWaterfall);
 
+    QToolButton* btnView = new QToolButton(toolBar);
+    btnView->setText("New view");
+    btnView->setToolButtonStyle( Qt::ToolButtonTextUnderIcon );
+    btnView->setToolTip("Open another view of the same data.");
+    toolBar->addWidget(btnView);
+    QObject::connect(btnView, &QToolButton::clicked, this, &MainWindow::openView);
+
     addToolBar(toolBar);
+
+    // load generator settings, applied when the generator is (re)started
+    QToolBar* loadToolBar = new QToolBar("Load generator", this);
+    auto addSpinBox = [loadToolBar](const QString& label, const int min, const int max, const int value)
+    {
+        loadToolBar->addWidget(new QLabel(label, loadToolBar));
+        QSpinBox* const box = new QSpinBox(loadToolBar);
+        box->setRange(min, max);
+        box->setValue(value);
+        loadToolBar->addWidget(box);
+        return box;
+    };
+    m_rateBox    = addSpinBox(" Layers/s ", 1, 100000, 100);
+    m_pointsBox  = addSpinBox(" Points ", 16, 65536, 1024);
+    m_historyBox = addSpinBox(" History ", 16, 100000, 512);
+    m_burstBox   = addSpinBox(" Burst ", 1, 1000, 1);
+
+    loadToolBar->addWidget(new QLabel(" Type ", loadToolBar));
+    m_typeBox = new QComboBox(loadToolBar);
+    m_typeBox->addItems(QStringList() << "float32" << "float64");
+    m_typeBox->setCurrentIndex(1);
+    loadToolBar->addWidget(m_typeBox);
+
+    loadToolBar->addWidget(new QLabel(" Signal ", loadToolBar));
+    m_shapeBox = new QComboBox(loadToolBar);
+    m_shapeBox->addItems(QStringList() << "Tones" << "Chirp" << "Noise");
+    loadToolBar->addWidget(m_shapeBox);
+    addToolBar(loadToolBar);
+
+    // data source: frames of any length are resampled to the current layer points
+    loadToolBar->addSeparator();
+    m_sourceEdit = new QLineEdit("tcp:127.0.0.1:5555", loadToolBar);
+    m_sourceEdit->setToolTip("serial:/dev/ttyUSB0[:baud], tcp:host:port, udp:port or pipe:/path");
+    loadToolBar->addWidget(m_sourceEdit);
+    QToolButton* btnSource = new QToolButton(loadToolBar);
+    btnSource->setText("Connect");
+    btnSource->setCheckable(true);
+    loadToolBar->addWidget(btnSource);
+
+    m_source = new WaterfallSource(m_waterfall, this);
+    connect(m_source, &WaterfallSource::errorOccurred, this, [this](const QString& error)
+    {
+        statusBar()->showMessage(QString("Source: %1").arg(error), 5000);
+    });
+    connect(btnSource, &QToolButton::toggled, this, [this, btnSource](const bool checked)
+    {
+        if (!checked)
+        {
+            m_source->close();
+            return;
+        }
+
+        double xMin, xMax;
+        size_t historyLength, layerPoints;
+        m_waterfall->getDataDimensions(xMin, xMax, historyLength, layerPoints);
+        if (layerPoints == 0)
+        {
+            m_waterfall->setDataDimensions(0, 500, size_t(m_historyBox->value()), size_t(m_pointsBox->value()));
+        }
+        m_waterfall->setRebinMode(WaterfallData<double>::RebinMax);
+
+        if (!m_source->open(m_sourceEdit->text()))
+        {
+            statusBar()->showMessage(QString("Source: %1").arg(m_source->errorString()), 5000);
+            btnSource->setChecked(false);
+        }
+    });
+
+    m_loadStats = new QLabel(this);
+    statusBar()->addPermanentWidget(m_loadStats);
+
+    m_generator = new LoadGenerator(this);
+    connect(m_generator, &LoadGenerator::layersReady, this, &MainWindow::addGeneratedLayers);
+    m_waterfall->setSpectrogramPaintedCallback([this]() { recordDisplayLatency(); });
+
+    QTimer* const statsTimer = new QTimer(this);
+    connect(statsTimer, &QTimer::timeout, this, &MainWindow::updateLoadStats);
+    statsTimer->start(500);
+
+    // data exports run in the background, one after the other
+    m_exporter = new WaterfallExporter(this);
+    connect(m_exporter, &WaterfallExporter::progress, this, [this](const int percent)
+    {
+        statusBar()->showMessage(QString("Exporting %1... %2%").arg(m_pendingExports.front().first).arg(percent));
+    });
+    connect(m_exporter, &WaterfallExporter::finished, this, [this](const bool success, const QString& error)
+    {
+        const QString fileName = m_pendingExports.front().first;
+        statusBar()->showMessage(success ? QString("%1 exported.").arg(fileName)
+                                         : QString("Failed to export %1: %2").arg(fileName, error), 5000);
+        m_pendingExports.erase(m_pendingExports.begin());
+        exportData();
+    });
+
+    // warm startup: the previous session is mapped, then saved every minute and on exit into
+    // a sibling file (never over the mapped one, which can't be replaced on Windows) that
+    // becomes the session at the next startup, before anything maps it
+    const QString sessionFile("waterfall.session");
+    const QString nextSessionFile("waterfall.session.next");
+    if (QFile::exists(nextSessionFile))
+    {
+        QFile::remove(sessionFile);
+        QFile::rename(nextSessionFile, sessionFile);
+    }
+    QString restoreError;
+    if (QFile::exists(sessionFile))
+    {
+        if (m_waterfall->restoreSession(sessionFile, &restoreError))
+        {
+            double xMin, xMax;
+            size_t historyLength, layerPoints;
+            m_waterfall->getDataDimensions(xMin, xMax, historyLength, layerPoints);
+            m_pointsBox->setValue(int(layerPoints));
+            m_historyBox->setValue(int(historyLength));
+            m_waterfall->replot();
+        }
+        else
+        {
+            statusBar()->showMessage(QString("Failed to restore %1: %2").arg(sessionFile, restoreError), 5000);
+        }
+    }
+    m_waterfall->setAutosave(nextSessionFile, 60000);
+    connect(&m_waterfall->sessionWriter(), &WaterfallSessionWriter::finished,
+            this, [this](const bool success, const QString& error)
+    {
+        if (!success)
+        {
+            statusBar()->showMessage(QString("Autosave failed: %1").arg(error), 5000);
+        }
+    });
+    connect(qApp, &QCoreApplication::aboutToQuit, this, [this, nextSessionFile]()
+    {
+        m_waterfall->saveSession(nextSessionFile);
+    });
 }
 
 int main( int argc, char **argv )
@@ -112,42 +318,99 @@ int main( int argc, char **argv )
     return a.exec();
 }
 
-void MainWindow::playData()
+void MainWindow::playData(const bool play)
 {
-    for (auto i = 0u; i < 32; ++i)
+    if (!play)
     {
-        std::vector<double> dummyData(126);
-        std::generate(dummyData.begin(), dummyData.end(), []{ return (std::rand() % 256); });
-
-        double xMin, xMax;
-        size_t historyLength, layerPoints;
-        m_waterfall->getDataDimensions(xMin, xMax, historyLength, layerPoints);
+        m_generator->stop();
+        return;
+    }
 
-        if (xMin != 0 || xMax != 500 ||
-            126 != layerPoints ||
-            64 != historyLength)
+    LoadGenerator::Settings settings;
+    settings.layersPerSecond = m_rateBox->value();
+    settings.layerPoints = size_t(m_pointsBox->value());
+    settings.burst = size_t(m_burstBox->value());
+    settings.type = LoadGenerator::SampleType(m_typeBox->currentIndex());
+    settings.shape = LoadGenerator::Shape(m_shapeBox->currentIndex());
+
+    double xMin, xMax;
+    size_t historyLength, layerPoints;
+    m_waterfall->getDataDimensions(xMin, xMax, historyLength, layerPoints);
+
+    const size_t history = size_t(m_historyBox->value());
+    if (xMin != 0 || xMax != 500 ||
+        settings.layerPoints != layerPoints ||
+        history != historyLength)
+    {
+        // the history of a restored session moves out of its file when it grows
+        if (!m_waterfall->setDataDimensions(0, 500, history, settings.layerPoints))
         {
-            // log/notify for debug purposes...
-            m_waterfall->setDataDimensions(0, 500, 64, dummyData.size());
+            statusBar()->showMessage("Invalid data dimensions.", 5000);
+            return;
         }
+    }
+    m_waterfall->setRange(0, 256); // range of the synthetic signals
+
+    m_latency.reset();
+    m_undisplayed.clear();
+    m_waterfall->resetStats();
+    m_generator->start(settings);
+}
+
+void MainWindow::addGeneratedLayers()
+{
+    m_generator->take(m_generatedLayers);
+    if (m_generatedLayers.empty())
+    {
+        return;
+    }
 
-        const bool bRet = m_waterfall->addData(dummyData.data(), dummyData.size(), std::time(nullptr));
-        assert(bRet);
+    // the whole batch is added before a single replot
+    for (const LoadGenerator::Layer& layer : m_generatedLayers)
+    {
+        m_waterfall->addData(layer.values.data(), layer.values.size(), layer.timestamp);
+    }
+    m_waterfall->replot(); // only schedules the paint
 
-        // set the range only once (data range)
-        static bool s_setRangeOnlyOnce = true;
-        if (s_setRangeOnlyOnce)
+    // the latency is recorded once the layers are painted (not while frozen, they aren't)
+    if (!m_waterfall->isFrozen() && m_undisplayed.size() < s_maxUndisplayed)
+    {
+        for (const LoadGenerator::Layer& layer : m_generatedLayers)
         {
-            double dataRng[2];
-            m_waterfall->getDataRange(dataRng[0], dataRng[1]);
-            m_waterfall->setRange(dataRng[0], dataRng[1]);
-            s_setRangeOnlyOnce = false;
+            m_undisplayed.push_back(layer.generated);
         }
+    }
+
+    m_generator->recycle(m_generatedLayers);
+}
 
-        m_waterfall->replot(true); // true: force repaint
+void MainWindow::recordDisplayLatency()
+{
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (const std::chrono::steady_clock::time_point generated : m_undisplayed)
+    {
+        m_latency.record(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now - generated).count()));
+    }
+    m_undisplayed.clear();
+}
 
-        QThread::msleep(10);
+void MainWindow::updateLoadStats()
+{
+    if (!m_generator->isRunning())
+    {
+        m_loadStats->clear();
+        return;
     }
+
+    // layers/s actually added vs the target rate, generation to display latency
+    const WaterfallStats stats = m_waterfall->stats();
+    m_loadStats->setText(QString("%1/%2 layers/s, display latency p50 %3 ms p99 %4 ms, %5 overruns, %6 dropped")
+                         .arg(stats.layersPerSecond, 0, 'f', 0)
+                         .arg(m_generator->settings().layersPerSecond, 0, 'f', 0)
+                         .arg(m_latency.quantile(0.5) / 1e6, 0, 'f', 1)
+                         .arg(m_latency.quantile(0.99) / 1e6, 0, 'f', 1)
+                         .arg(m_generator->overruns())
+                         .arg(stats.droppedFrames));
 }
 
 void MainWindow::clearWaterfall()
@@ -156,6 +419,33 @@ void MainWindow::clearWaterfall()
     m_waterfall->replot(true); // true: force repaint
 }
 
+void MainWindow::openView()
+{
+    // the data is shared: it must exist (its dimensions are set when data is first received)
+    if (!m_waterfall->store())
+    {
+        statusBar()->showMessage("No data to show yet.", 3000);
+        return;
+    }
+
+    Waterfallplot* const view = new Waterfallplot(nullptr, m_waterfall->getColorMap());
+    if (m_waterfall->getColorMapPreset())
+    {
+        view->setColorMap(*m_waterfall->getColorMapPreset());
+    }
+    view->setAttribute(Qt::WA_DeleteOnClose);
+    view->setTitle("Waterfall Demo (view)");
+    view->setXLabel("Distance (m)", 10);
+    view->setXTooltipUnit("m");
+    view->setZTooltipUnit("°C");
+    view->setYLabel("Time", 10);
+    view->setZLabel("Temperature (°C)", 10);
+    view->shareData(*m_waterfall);
+    view->resize(800, 600);
+    view->show();
+    view->replot();
+}
+
 void MainWindow::exportPlots()
 {
     ExportDialog dialog(this);
@@ -177,25 +467,50 @@ void MainWindow::exportPlots()
         {
             renderer.exportTo(m_waterfall->getVerticalCurvePlot(), "vertical_plot.pdf");
         }
+
+        const bool idle = m_pendingExports.empty();
+        if (dialog.getExportWaterfallDataNpy())
+        {
+            m_pendingExports.emplace_back("waterfall.npy", WaterfallExporter::Npy);
+        }
+        if (dialog.getExportWaterfallDataCsv())
+        {
+            m_pendingExports.emplace_back("waterfall.csv", WaterfallExporter::Csv);
+        }
+        if (idle)
+        {
+            exportData();
+        }
     }
 }
 
-void MainWindow::changeColorMap()
+void MainWindow::exportData()
 {
-    static bool s_useBBRColorMap = true;
-    if (s_useBBRColorMap)
+    if (m_pendingExports.empty() || m_exporter->isRunning())
     {
-
-        m_waterfall->setColorMap(ColorMaps::BlackBodyRadiation());
-        m_waterfall->replot();
-
-        s_useBBRColorMap = false;
+        return;
     }
-    else
-    {
-        m_waterfall->setColorMap(ColorMaps::Jet());
-        m_waterfall->replot();
 
-        s_useBBRColorMap = true;
+    const WaterfallData<double>* const data = m_waterfall->data();
+    if (!data)
+    {
+        m_pendingExports.clear();
+        return;
     }
+
+    // the history is copied and written by the exporter's worker, the store is kept alive meanwhile
+    m_exporter->start(std::shared_ptr<const WaterfallData<double>>(m_waterfall->store(), data), QRectF(),
+                      m_pendingExports.front().first, m_pendingExports.front().second);
+}
+
+void MainWindow::changeColorMap()
+{
+    // cycles through the baked color maps
+    static int s_preset = ColorMaps::JetPreset;
+    s_preset = (s_preset + 1) % ColorMaps::PresetCount;
+
+    const ColorMaps::ColorMap& colorMap = ColorMaps::preset(ColorMaps::Preset(s_preset));
+    m_waterfall->setColorMap(colorMap);
+    m_waterfall->replot();
+    statusBar()->showMessage(QString("Color map: %1").arg(colorMap.name), 3000);
 }